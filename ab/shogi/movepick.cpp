@@ -0,0 +1,197 @@
+#include "movepick.h"
+#include <algorithm>
+#include <cstdlib>
+
+void ButterflyHistory::clear() {
+    for (auto &t : table) {
+        std::fill(std::begin(t), std::end(t), 0);
+    }
+}
+
+// 上限に近いほど増え方が小さくなるように足す（値は±HISTORY_MAXに収まる）
+void ButterflyHistory::update(Color c, Move m, int bonus) {
+    int &h = table[c][index(m)];
+    h += bonus - h * std::abs(bonus) / HISTORY_MAX;
+}
+
+void CounterMoveHistory::clear() {
+    for (auto &t : table) {
+        std::fill(std::begin(t), std::end(t), Move(Move::NONE));
+    }
+}
+
+// MVV-LVA：価値の高い駒を、価値の低い駒で捕る手ほど点数を高くする
+static int mvv_lva(const Position &pos, Move m) {
+    Piece attacker = type_of(pos.piece_board[m.get_from()]);
+    return PIECE_VALUE[m.get_captured_piece()] * 64 - PIECE_VALUE[attacker];
+}
+
+MovePicker::MovePicker(Position &pos, Move tt_move, const Move *killers,
+                       Move counter_move, const ButterflyHistory &history)
+    : pos(pos), history(history), tt_move(tt_move),
+      counter_move(counter_move) {
+    this->killers[0] = killers[0];
+    this->killers[1] = killers[1];
+    // 王手されているときは合法手が少ないので、まとめて生成する
+    if (pos.is_check(pos.side_to_move)) {
+        stage = STAGE_EVASIONS_INIT;
+        return;
+    }
+    // 置換表の手は別の局面のものかもしれないので、合法かどうかを確かめる
+    if (!is_legal_move(pos, this->tt_move)) {
+        this->tt_move = Move(Move::NONE);
+    }
+    stage = STAGE_TT;
+}
+
+void MovePicker::generate(GenType type) {
+    MoveList list;
+    generate_legal_moves(pos, list, type);
+    cur = 0;
+    end = 0;
+    for (auto m : list) {
+        moves[end++] = {m, 0};
+    }
+}
+
+void MovePicker::score_captures() {
+    for (int i = cur; i < end; ++i) {
+        moves[i].score = mvv_lva(pos, moves[i].move);
+    }
+}
+
+void MovePicker::score_quiets() {
+    for (int i = cur; i < end; ++i) {
+        moves[i].score = history.get(pos.side_to_move, moves[i].move);
+    }
+    // 点数が同じなら生成した順を保つ
+    std::stable_sort(moves + cur, moves + end,
+                     [](const ExtMove &a, const ExtMove &b) {
+                         return a.score > b.score;
+                     });
+}
+
+void MovePicker::score_evasions() {
+    for (int i = cur; i < end; ++i) {
+        Move m = moves[i].move;
+        if (m == tt_move) {
+            moves[i].score = 1 << 30;
+        } else if (!m.is_drop() && m.get_captured_piece() != NO_PIECE) {
+            moves[i].score = (1 << 20) + mvv_lva(pos, m);
+        } else {
+            moves[i].score = history.get(pos.side_to_move, m);
+        }
+    }
+    std::stable_sort(moves + cur, moves + end,
+                     [](const ExtMove &a, const ExtMove &b) {
+                         return a.score > b.score;
+                     });
+}
+
+Move MovePicker::pick_best() {
+    int best = cur;
+    for (int i = cur + 1; i < end; ++i) {
+        if (moves[i].score > moves[best].score) {
+            best = i;
+        }
+    }
+    std::swap(moves[cur], moves[best]);
+    return moves[cur++].move;
+}
+
+bool MovePicker::is_special(Move m) const {
+    return m == tt_move || m == killers[0] || m == killers[1] ||
+           m == counter_move;
+}
+
+Move MovePicker::next_move() {
+    while (true) {
+        switch (stage) {
+        case STAGE_TT:
+            ++stage;
+            if (!tt_move.is_none()) {
+                return tt_move;
+            }
+            break;
+
+        case STAGE_CAPTURES_INIT:
+            generate(GEN_CAPTURES);
+            score_captures();
+            ++stage;
+            break;
+
+        case STAGE_CAPTURES:
+            while (cur < end) {
+                Move m = pick_best();
+                if (m != tt_move) {
+                    return m;
+                }
+            }
+            ++stage;
+            break;
+
+        // キラー手とカウンター手は駒を捕らない手なので、捕る手と重なることはない
+        case STAGE_KILLER1:
+        case STAGE_KILLER2: {
+            const int i = stage - STAGE_KILLER1;
+            Move m = killers[i];
+            ++stage;
+            // 2つ目のキラー手が1つ目と同じなら返さない
+            if (!m.is_none() && m != tt_move && (i == 0 || m != killers[0]) &&
+                is_legal_move(pos, m)) {
+                return m;
+            }
+            break;
+        }
+
+        case STAGE_COUNTER:
+            ++stage;
+            if (!counter_move.is_none() && counter_move != tt_move &&
+                counter_move != killers[0] && counter_move != killers[1] &&
+                is_legal_move(pos, counter_move)) {
+                return counter_move;
+            }
+            break;
+
+        case STAGE_QUIETS_INIT:
+            generate(GEN_QUIETS);
+            score_quiets();
+            ++stage;
+            break;
+
+        case STAGE_DROPS_INIT:
+            generate(GEN_DROPS);
+            score_quiets();
+            ++stage;
+            break;
+
+        case STAGE_QUIETS:
+        case STAGE_DROPS:
+            while (cur < end) {
+                Move m = moves[cur++].move;
+                if (!is_special(m)) {
+                    return m;
+                }
+            }
+            // 駒を捕らない手の次は駒打ち、駒打ちの次は終わり
+            stage = stage == STAGE_QUIETS ? STAGE_DROPS_INIT : STAGE_END;
+            break;
+
+        case STAGE_EVASIONS_INIT:
+            generate(GEN_ALL);
+            score_evasions();
+            ++stage;
+            break;
+
+        case STAGE_EVASIONS:
+            if (cur < end) {
+                return moves[cur++].move;
+            }
+            stage = STAGE_END;
+            break;
+
+        default:
+            return Move(Move::NONE);
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "../common/movegen.h"
+#include "../common/position.h"
+#include "params.h"
+
+// 駒を捕らない手（駒打ちを含む）がβカットを起こした実績
+// 手番と「移動元（駒打ちなら打つ駒）・移動先」ごとに持つ（成り・不成は区別しない）
+struct ButterflyHistory {
+    static const int INDEX_NB = 2048;
+    int table[COLOR_NB][INDEX_NB];
+
+    static int index(Move m) {
+        return (m.value & 0x3FF) | (m.is_drop() ? 0x400 : 0);
+    }
+    void clear();
+    int get(Color c, Move m) const { return table[c][index(m)]; }
+    // 増やすときはbonus > 0、減らすときはbonus < 0
+    void update(Color c, Move m, int bonus);
+};
+
+// 1つ前の手（動いた駒と移動先）に対して、βカットを起こした応手
+struct CounterMoveHistory {
+    Move table[COLOR_PIECE_NB][SQ_NB];
+
+    void clear();
+    Move get(Piece pc, Square sq) const { return table[pc][sq]; }
+    void set(Piece pc, Square sq, Move m) { table[pc][sq] = m; }
+};
+
+// 指し手と、並べ替えに使う点数
+struct ExtMove {
+    Move move;
+    int score;
+};
+
+// ノードの指し手を段階的に生成して、良さそうな順に1手ずつ返すクラス
+// 王手されていないときは次の順に返し、βカットが起きれば残りの段階は生成しない
+//   置換表の手 → 駒を捕る手（MVV-LVA順） → キラー手 → カウンター手
+//   → 駒を捕らない手（履歴順） → 駒打ち（履歴順）
+// 王手されているときは全ての合法手を生成して、置換表の手・駒を捕る手・履歴の順に返す
+class MovePicker {
+  public:
+    MovePicker(Position &pos, Move tt_move, const Move *killers,
+               Move counter_move, const ButterflyHistory &history);
+    // 次の指し手を返す。もう指し手がなければNONEを返す
+    Move next_move();
+
+  private:
+    enum Stage {
+        STAGE_TT,
+        STAGE_CAPTURES_INIT,
+        STAGE_CAPTURES,
+        STAGE_KILLER1,
+        STAGE_KILLER2,
+        STAGE_COUNTER,
+        STAGE_QUIETS_INIT,
+        STAGE_QUIETS,
+        STAGE_DROPS_INIT,
+        STAGE_DROPS,
+        STAGE_EVASIONS_INIT,
+        STAGE_EVASIONS,
+        STAGE_END,
+    };
+
+    void generate(GenType type);
+    void score_captures();
+    void score_quiets();
+    void score_evasions();
+    // 残りの中で点数が最大の手を返す（選択ソートを1段だけ進める）
+    Move pick_best();
+    // 置換表の手・キラー手・カウンター手として既に返した手かどうか
+    bool is_special(Move m) const;
+
+    Position &pos;
+    const ButterflyHistory &history;
+    Move tt_move;
+    Move killers[2];
+    Move counter_move;
+    int stage;
+    ExtMove moves[MAX_MOVES];
+    int cur = 0;
+    int end = 0;
+};
@@ -1,13 +1,52 @@
 #pragma once
 #include "../common/shogi.h"
-#include <map>
 
 const double INFTY = 10000;
 
 // 深さは原則偶数にすること
 const int MAX_DEPTH = 10;
+// 探索の手数の上限（探索スタックの大きさ）
+const int MAX_PLY = 64;
 
-inline std::map<Piece, int> PIECE_VALUE_MAP = {
-    {PAWN, 1}, {SILVER, 5},   {GOLD, 6},       {BISHOP, 8}, {ROOK, 10},
-    {KING, 0}, {PRO_PAWN, 4}, {PRO_SILVER, 6}, {HORSE, 11}, {DRAGON, 12},
-};
+// 詰みの評価値。rootからply手目で詰むときは MATE_SCORE - ply になる
+const double MATE_SCORE = 9000;
+// これ以上の絶対値の評価値は詰みを表す
+const double MATE_THRESHOLD = MATE_SCORE - MAX_PLY;
+
+// 置換表のデフォルトサイズ(MB)。USIのsetoption name Hashで変更できる。
+const int TT_SIZE_MB = 16;
+
+// 探索スレッド数のデフォルト値。USIのsetoption name Threadsで変更できる。
+const int THREAD_NUM = 1;
+const int MAX_THREAD_NUM = 256;
+
+// 駒を捕らない手の履歴の値の上限（絶対値）
+// βカットを起こした手に深さ^2を足し、上限に近づくほど増え方を小さくする
+const int HISTORY_MAX = 16384;
+
+// 静止探索のデルタ枝刈りの余裕（評価値の幅）
+// 静的評価値に捕る駒の価値とこの余裕を足してもαに届かない駒を捕る手は読まない
+const double DELTA_MARGIN = 0.05;
+
+// 枝刈りの設定のデフォルト値。USIのsetoptionで変更できる。
+// null move pruningで減らす深さ
+const int NULL_MOVE_REDUCTION = 2;
+// late move reductionsを行う最小の深さと、何手目から深さを減らすか
+const int LMR_MIN_DEPTH = 3;
+const int LMR_MOVE_COUNT = 4;
+// futility pruningを行う最大の深さと、深さ1あたりの余裕（評価値の1000倍）
+const int FUTILITY_MAX_DEPTH = 2;
+const int FUTILITY_MARGIN = 100;
+
+// aspiration windows：前回の反復の評価値から上下にとる窓の幅（評価値の1000倍）
+// 窓の外に出るたびに幅を2倍にし、ASPIRATION_MAX_DELTAに達したら窓をなくす
+const int ASPIRATION_DELTA = 25;
+const double ASPIRATION_MAX_DELTA = 0.5;
+// aspiration windowsを使い始める深さ（浅い反復は評価値が安定しない）
+const int ASPIRATION_MIN_DEPTH = 4;
+
+// 探索の延長は1手をONE_PLYに分けた単位で数え、1手分貯まったら深さを1手延ばす
+const int ONE_PLY = 4;
+// 王手をかける手と、直前に捕られた駒を取り返す手の延長（1/ONE_PLY手単位）
+const int CHECK_EXTENSION = 2;
+const int RECAPTURE_EXTENSION = 2;
@@ -1,49 +1,269 @@
 #include "root.h"
+#include "search.h"
+#include "tt.h"
 #include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <thread>
 
 Root::Root() {
     pos = Position();
     srand(time(nullptr));
+    TT.resize(TT_SIZE_MB);
 }
 
-Move Root::search() {
-    Move m = Move(Move::NONE);
-    Node *root = new Node(pos, m);
-    root->search(INFTY);
+void Root::send_options() {
+    std::cout << "option name Hash type spin default " << TT_SIZE_MB
+              << " min 1 max 4096" << std::endl;
+    std::cout << "option name Threads type spin default " << THREAD_NUM
+              << " min 1 max " << MAX_THREAD_NUM << std::endl;
+    // 評価関数の選択：NNUEの重みファイルを指定すればNNUE、空なら駒の価値
+    std::cout << "option name EvalFile type string default <empty>"
+              << std::endl;
+    std::cout << "option name TrainingDataFile type string default <empty>"
+              << std::endl;
+    // 探索の枝刈りの設定（強さの調整用）
+    const SearchOptions defaults;
+    auto check = [](bool value) { return value ? "true" : "false"; };
+    std::cout << "option name PVS type check default " << check(defaults.pvs)
+              << std::endl;
+    std::cout << "option name NullMove type check default "
+              << check(defaults.null_move) << std::endl;
+    std::cout << "option name NullMoveReduction type spin default "
+              << defaults.null_move_reduction << " min 1 max 4" << std::endl;
+    std::cout << "option name LMR type check default " << check(defaults.lmr)
+              << std::endl;
+    std::cout << "option name LMRMinDepth type spin default "
+              << defaults.lmr_min_depth << " min 2 max 16" << std::endl;
+    std::cout << "option name LMRMoveCount type spin default "
+              << defaults.lmr_move_count << " min 1 max 64" << std::endl;
+    std::cout << "option name Futility type check default "
+              << check(defaults.futility) << std::endl;
+    std::cout << "option name FutilityMaxDepth type spin default "
+              << defaults.futility_max_depth << " min 1 max 8" << std::endl;
+    std::cout << "option name FutilityMargin type spin default "
+              << defaults.futility_margin << " min 0 max 1000" << std::endl;
+    std::cout << "option name Aspiration type check default "
+              << check(defaults.aspiration) << std::endl;
+    std::cout << "option name AspirationDelta type spin default "
+              << defaults.aspiration_delta << " min 1 max 500" << std::endl;
+    std::cout << "option name CheckExtension type spin default "
+              << defaults.check_extension << " min 0 max " << ONE_PLY
+              << std::endl;
+    std::cout << "option name RecaptureExtension type spin default "
+              << defaults.recapture_extension << " min 0 max " << ONE_PLY
+              << std::endl;
+}
+
+// USIで空の文字列を表す値
+static bool is_empty_option(const std::string &value) {
+    return value.empty() || value == "<empty>";
+}
+
+void Root::set_option(const std::string &name, const std::string &value) {
+    if (name == "Hash" || name == "USI_Hash") {
+        TT.resize(std::clamp(std::stoi(value), 1, 4096));
+    } else if (name == "Threads") {
+        thread_num = std::clamp(std::stoi(value), 1, MAX_THREAD_NUM);
+    } else if (name == "EvalFile") {
+        // 置換表の評価値は前の評価関数のものなので捨てる
+        TT.clear();
+        if (is_empty_option(value)) {
+            NNUE::load("");
+        } else if (NNUE::load(value)) {
+            std::cout << "info string NNUE: " << value << std::endl;
+        } else {
+            std::cout << "info string failed to read NNUE: " << value
+                      << std::endl;
+        }
+    } else if (name == "TrainingDataFile") {
+        training_data_path = is_empty_option(value) ? "" : value;
+    } else if (name == "PVS") {
+        search_options.pvs = value == "true";
+    } else if (name == "NullMove") {
+        search_options.null_move = value == "true";
+    } else if (name == "NullMoveReduction") {
+        search_options.null_move_reduction = std::clamp(std::stoi(value), 1, 4);
+    } else if (name == "LMR") {
+        search_options.lmr = value == "true";
+    } else if (name == "LMRMinDepth") {
+        search_options.lmr_min_depth = std::clamp(std::stoi(value), 2, 16);
+    } else if (name == "LMRMoveCount") {
+        search_options.lmr_move_count = std::clamp(std::stoi(value), 1, 64);
+    } else if (name == "Futility") {
+        search_options.futility = value == "true";
+    } else if (name == "FutilityMaxDepth") {
+        search_options.futility_max_depth = std::clamp(std::stoi(value), 1, 8);
+    } else if (name == "FutilityMargin") {
+        search_options.futility_margin = std::clamp(std::stoi(value), 0, 1000);
+    } else if (name == "Aspiration") {
+        search_options.aspiration = value == "true";
+    } else if (name == "AspirationDelta") {
+        search_options.aspiration_delta = std::clamp(std::stoi(value), 1, 500);
+    } else if (name == "CheckExtension") {
+        search_options.check_extension =
+            std::clamp(std::stoi(value), 0, ONE_PLY);
+    } else if (name == "RecaptureExtension") {
+        search_options.recapture_extension =
+            std::clamp(std::stoi(value), 0, ONE_PLY);
+    }
+}
+
+// この探索部はプレイアウトのモデルを使わないので、確かめるものがない
+bool Root::check_network() {
+    std::cout << "this engine has no playout network" << std::endl;
+    return true;
+}
 
+// USIのinfoコマンド用に評価値を文字列にする
+// 評価値は駒の価値の割合の差なので、1000倍してcpとして出力する
+static std::string score_to_usi(double score) {
+    if (std::fabs(score) >= MATE_THRESHOLD) {
+        int ply = (int)std::round(MATE_SCORE - std::fabs(score));
+        return "mate " + std::to_string(score > 0 ? ply : -ply);
+    }
+    return "cp " + std::to_string((int)std::round(score * 1000));
+}
+
+Move Root::search(const SearchLimits &limits) {
+    TT.new_search();
+    TimeManager time_manager;
+    time_manager.init(limits, pos.side_to_move);
+
+    // Lazy SMP：全スレッドが同じ局面を探索し、置換表を通して結果を共有する
+    // 指し手を決めるのはメインスレッド(searchers[0])だけで、
+    // ヘルパースレッドは深さをずらして置換表を埋める
+    std::atomic<bool> stop(false);
+    std::vector<std::unique_ptr<Searcher>> searchers;
+    for (int i = 0; i < thread_num; ++i) {
+        searchers.push_back(std::make_unique<Searcher>(
+            pos, stop, i, i == 0 ? &time_manager : nullptr, search_options));
+    }
+    Searcher &searcher = *searchers[0];
     // 合法手がない場合は投了
-    if (root->children.size() == 0) {
+    if (searcher.root_moves.empty()) {
         return Move(Move::RESIGN);
     }
+    auto total_nodes = [&searchers]() {
+        uint64_t n = 0;
+        for (auto &s : searchers) {
+            n += s->nodes.load(std::memory_order_relaxed);
+        }
+        return n;
+    };
 
-    // 評価値の高い順にソート
-    std::sort(root->children.begin(), root->children.end(), Node::compare);
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < thread_num; ++i) {
+        helpers.emplace_back(&Searcher::helper_loop, searchers[i].get());
+    }
 
-    std::cout << "=== SCORE ===\n";
-    for (auto &child : root->children) {
-        std::cout << child->move << ": " << child->score << "\n";
+    // 探索深さの上限。時間の指定があれば時間が許す限り深く読む。
+    int max_depth = limits.depth > 0                 ? limits.depth
+                    : time_manager.enabled()         ? MAX_PLY - 1
+                    : limits.infinite                ? MAX_PLY - 1
+                                                     : MAX_DEPTH;
+    max_depth = std::min(max_depth, MAX_PLY - 1);
+
+    // 反復深化：深さ1から順に探索し、最後に読み切った深さの結果を使う
+    std::vector<RootMove> completed;
+    int completed_depth = 0;
+    for (int depth = 1; depth <= max_depth; ++depth) {
+        if (!searcher.search_root(depth)) {
+            break;
+        }
+        completed = searcher.root_moves;
+        completed_depth = depth;
+
+        int64_t elapsed = time_manager.elapsed();
+        uint64_t nodes = total_nodes();
+        std::cout << "info depth " << depth << " score "
+                  << score_to_usi(completed[0].score) << " nodes " << nodes
+                  << " nps " << nodes * 1000 / std::max<int64_t>(elapsed, 1)
+                  << " time " << elapsed << " pv";
+        for (auto m : completed[0].pv) {
+            std::cout << " " << m;
+        }
+        std::cout << std::endl;
+
+        // 深さ1の探索中にstopが来た場合は、ここで打ち切る
+        if (time_manager.stop_requested()) {
+            break;
+        }
+        if (time_manager.enabled()) {
+            // 合法手が1つしかなければ考えるまでもない
+            if (completed.size() == 1) {
+                break;
+            }
+            // 次の反復は今回より長くかかるので、予定の半分を過ぎたら打ち切る
+            if (elapsed >= time_manager.optimum() / 2) {
+                break;
+            }
+        }
     }
 
-    // 最も評価の高いノードが違法手の場合（＝合法手がない場合）も投了
-    Node *best_node = root->children[0];
-    if (best_node->is_illegal) {
-        return Move(Move::RESIGN);
+    // メインスレッドの探索が終わったらヘルパースレッドも止める
+    stop = true;
+    for (auto &th : helpers) {
+        th.join();
     }
 
-    // best_nodeと評価値が同じやつを探す
-    std::vector<Node *> candidates;
-    for (Node *node : root->children) {
-        if (node->score == best_node->score) {
-            candidates.push_back(node);
+    // 置換表と、探索し直した回数の統計を出力
+    uint64_t tt_probe_cnt = 0, tt_hit_cnt = 0, tt_cut_cnt = 0;
+    uint64_t fail_high_cnt = 0, fail_low_cnt = 0, pvs_cnt = 0, lmr_cnt = 0;
+    for (auto &s : searchers) {
+        tt_probe_cnt += s->tt_probe_cnt;
+        tt_hit_cnt += s->tt_hit_cnt;
+        tt_cut_cnt += s->tt_cut_cnt;
+        fail_high_cnt += s->aspiration_fail_high_cnt;
+        fail_low_cnt += s->aspiration_fail_low_cnt;
+        pvs_cnt += s->pvs_research_cnt;
+        lmr_cnt += s->lmr_research_cnt;
+    }
+    double hit_rate =
+        tt_probe_cnt == 0 ? 0 : 100.0 * tt_hit_cnt / tt_probe_cnt;
+    int64_t elapsed = time_manager.elapsed();
+    uint64_t nodes = total_nodes();
+    std::cout << "depth: " << completed_depth << ", threads: " << thread_num
+              << ", nodes: " << nodes
+              << ", nps: " << nodes * 1000 / std::max<int64_t>(elapsed, 1)
+              << ", tt probes: " << tt_probe_cnt << ", hits: " << tt_hit_cnt
+              << " (" << std::fixed << std::setprecision(1) << hit_rate
+              << "%)"
+              << ", cutoffs: " << tt_cut_cnt << ", hashfull: " << TT.hashfull()
+              << std::endl;
+    std::cout << "re-searches: aspiration fail high " << fail_high_cnt
+              << ", fail low " << fail_low_cnt << ", pvs " << pvs_cnt
+              << ", lmr " << lmr_cnt << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+
+    std::cout << "=== SCORE ===\n";
+    for (auto &rm : completed) {
+        std::cout << rm.move << ": " << rm.score << "\n";
+    }
+
+    // 最善手と評価値が同じ手を探す（completedは評価値の高い順に並んでいる）
+    const RootMove &best = completed[0];
+
+    // 学習データとして、rootの局面と手番側の勝率（評価値 + 0.5）を書き出す
+    if (!training_data_path.empty()) {
+        double target = best.score >= MATE_THRESHOLD    ? 1.0
+                        : best.score <= -MATE_THRESHOLD ? 0.0
+                                                        : best.score + 0.5;
+        std::ofstream ofs(training_data_path, std::ios::app);
+        NNUE::write_training_record(ofs, pos,
+                                    std::clamp(target, 0.0, 1.0));
+    }
+    std::vector<Move> candidates;
+    for (auto &rm : completed) {
+        if (rm.score == best.score) {
+            candidates.push_back(rm.move);
         }
     }
 
     // その中からランダムに選ぶ
     int idx = rand() % candidates.size();
-    best_node = candidates[idx];
-    Move best_move = best_node->move;
-
-    delete root;
-
-    return best_move;
+    return candidates[idx];
 }
@@ -1,9 +1,22 @@
 #include "../common/position.h"
-#include "node.h"
+#include "../common/timeman.h"
+#include "search.h"
+#include <string>
 
 class Root {
   public:
     Root();
     Position pos;
-    Move search();
+    Move search(const SearchLimits &limits);
+    // USIのオプション
+    void send_options();
+    void set_option(const std::string &name, const std::string &value);
+    // プレイアウトのモデルの検証（モデルを使うのはhybridだけ）
+    bool check_network();
+
+  private:
+    int thread_num = THREAD_NUM; // 探索スレッド数（Lazy SMP）
+    SearchOptions search_options; // 探索の枝刈りの設定
+    // 探索した局面と評価値を書き出すファイル（NNUEの学習データ）。空なら書き出さない。
+    std::string training_data_path;
 };
@@ -0,0 +1,557 @@
+#include "search.h"
+#include "tt.h"
+#include <algorithm>
+#include <cmath>
+
+// rootの指し手で評価値が同じものを区別するための微小な幅
+const double TIE_EPSILON = 1e-9;
+// PVSで、αを超えるかどうかだけを調べるときの窓の幅
+const double ZERO_WINDOW = 1e-9;
+// null moveの代わりにrepetitionsに積むハッシュ値
+// 実際の局面と一致することはまず無いので、この局面を通る千日手は見つからない
+const HASH_KEY NULL_MOVE_KEY = 0;
+
+// 何ノードごとに経過時間を確認するか
+const uint64_t CHECK_TIME_INTERVAL = 1024;
+
+// ヘルパースレッドが飛ばす深さのパターン
+// 各スレッドが別々の深さを探索するように、スレッドごとに周期と位相をずらす
+const int SKIP_PATTERN_NB = 20;
+const int SKIP_SIZE[SKIP_PATTERN_NB] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                        3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+const int SKIP_PHASE[SKIP_PATTERN_NB] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3,
+                                         4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+Searcher::Searcher(const Position &pos, std::atomic<bool> &stop,
+                   int thread_id, const TimeManager *time_manager,
+                   const SearchOptions &options)
+    : pos(pos), stop(stop), thread_id(thread_id), time_manager(time_manager),
+      options(options) {
+    for (int i = 0; i < MAX_PLY + 2; ++i) {
+        stack[i].ply = i;
+    }
+    if (NNUE::is_loaded()) {
+        nnue_stack.reset(this->pos);
+        this->pos.nnue = &nnue_stack;
+    }
+    // 対局中の局面はスレッドごとにコピーして、そこに探索中の局面を積んでいく
+    repetitions = game_history;
+    game_ply = repetitions.size();
+    history.clear();
+    counter_moves.clear();
+
+    // rootの合法手を列挙する（千日手になる手も除く）
+    MoveList move_list = generate_legal_moves(this->pos);
+    sort_move_list(move_list, this->pos);
+    for (auto move : move_list) {
+        this->pos.do_move(move);
+        if (!push_position()) {
+            pop_position();
+            root_moves.push_back(RootMove(move));
+        }
+        this->pos.undo_move(move);
+    }
+}
+
+bool Searcher::search_root(int depth) {
+    root_depth = depth;
+    // root_movesは前回の反復の評価値の高い順に並んでいるので、先頭が前回の最善手
+    prev_pv = root_moves[0].pv;
+
+    HASH_KEY key = pos.get_hash_key();
+    bool tt_hit;
+    TTEntry tt_data;
+    TTEntry *tte = TT.probe(key, tt_hit, tt_data);
+    // 前回の反復が無ければ、置換表の最善手を最初に探索する
+    if (tt_hit && prev_pv.empty()) {
+        Move tt_move = tt_data.get_move();
+        auto it = std::find_if(
+            root_moves.begin(), root_moves.end(),
+            [tt_move](const RootMove &rm) { return rm.move == tt_move; });
+        if (it != root_moves.end()) {
+            std::rotate(root_moves.begin(), it, it + 1);
+        }
+    }
+
+    nodes.fetch_add(1, std::memory_order_relaxed);
+    // aspiration windows：前回の反復の評価値の周りの狭い窓で探索し、
+    // 窓の外に出たら、その側の窓を広げて探索し直す
+    const double prev_score = root_moves[0].score;
+    double delta = options.aspiration_delta / 1000.0;
+    double alpha = -INFTY, beta = INFTY;
+    if (options.aspiration && depth >= ASPIRATION_MIN_DEPTH &&
+        std::fabs(prev_score) < MATE_THRESHOLD) {
+        alpha = prev_score - delta;
+        beta = prev_score + delta;
+    }
+    while (true) {
+        double best_score = search_root_moves(depth, alpha, beta);
+        if (stop) {
+            return false;
+        }
+        if (best_score <= alpha) {
+            aspiration_fail_low_cnt++;
+            alpha = best_score - delta;
+        } else if (best_score >= beta) {
+            aspiration_fail_high_cnt++;
+            beta = best_score + delta;
+        } else {
+            break;
+        }
+        delta *= 2;
+        // 窓が十分に広がっても収まらなければ、窓なしで探索する
+        if (delta >= ASPIRATION_MAX_DELTA) {
+            alpha = -INFTY;
+            beta = INFTY;
+        }
+    }
+
+    // 評価値の高い順に並べる（同じ評価値なら探索した順を保つ）
+    std::stable_sort(root_moves.begin(), root_moves.end());
+
+    tte->save(key, score_to_tt(root_moves[0].score, 0), BOUND_EXACT, depth,
+              root_moves[0].move, TT.generation());
+    return true;
+}
+
+double Searcher::search_root_moves(int depth, double alpha, double beta) {
+    double best_score = -INFTY;
+    for (size_t i = 0; i < root_moves.size(); ++i) {
+        RootMove &rm = root_moves[i];
+        stack[0].current_move = rm.move;
+        stack[1].extension = 0;
+        const bool on_pv = !prev_pv.empty() && rm.move == prev_pv[0];
+        pos.do_move(rm.move);
+        push_position();
+        // 最善手と同じ評価値の手も正確な評価値が得られるように、窓を少し広げる
+        const double bound = alpha - TIE_EPSILON;
+        double value = -INFTY;
+        // PVS：最初の手以外は、boundを超えるかどうかを先に幅0の窓で調べる
+        const bool zero_window = options.pvs && i > 0;
+        if (zero_window) {
+            follow_pv = on_pv;
+            value = -search(&stack[1], -(bound + ZERO_WINDOW), -bound,
+                            depth - 1);
+        }
+        if (!zero_window || (value > bound && value < beta)) {
+            pvs_research_cnt += zero_window;
+            follow_pv = on_pv;
+            value = -search(&stack[1], -beta, -bound, depth - 1);
+        }
+        pop_position();
+        pos.undo_move(rm.move);
+        if (stop) {
+            return best_score;
+        }
+
+        rm.score = value;
+        if (value > bound) {
+            rm.pv.assign(1, rm.move);
+            rm.pv.insert(rm.pv.end(), stack[1].pv,
+                         stack[1].pv + stack[1].pv_len);
+        }
+        best_score = std::max(best_score, value);
+        if (value > alpha) {
+            alpha = value;
+            // βを超えたら、この手を先頭に移して窓を広げた探索で最初に読む
+            if (alpha >= beta) {
+                std::rotate(root_moves.begin(), root_moves.begin() + i,
+                            root_moves.begin() + i + 1);
+                break;
+            }
+        }
+    }
+    return best_score;
+}
+
+void Searcher::helper_loop() {
+    const int idx = (thread_id - 1) % SKIP_PATTERN_NB;
+    for (int depth = 1; depth < MAX_PLY && !stop; ++depth) {
+        // メインスレッドと同じ深さばかり探索しないように、一部の深さを飛ばす
+        if ((depth + SKIP_PHASE[idx]) / SKIP_SIZE[idx] % 2 == 1) {
+            continue;
+        }
+        search_root(depth);
+    }
+}
+
+// 持ち駒がなく、盤上にも玉と歩しかなければ、パスするより悪い手しかない局面
+// （zugzwang）になりやすいので、null move pruningを行わない
+static bool null_move_allowed(Position &pos) {
+    const Color us = pos.side_to_move;
+    const int w = us * PIECE_WHITE;
+    Bitboard others = pos.occupied_bb(us) & ~pos.piece_bitboards[KING + w] &
+                      ~pos.piece_bitboards[PAWN + w];
+    return pos.hands[us] != HAND_ZERO || others.p != 0;
+}
+
+double Searcher::search(Stack *ss, double alpha, double beta, int depth) {
+    // 深さの上限に達したら、駒の取り合いが落ち着くまで静止探索で読む
+    if (depth <= 0 || ss->ply >= MAX_PLY) {
+        return qsearch(ss, alpha, beta, 0);
+    }
+
+    uint64_t n = nodes.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (n % CHECK_TIME_INTERVAL == 0) {
+        check_time();
+    }
+    if (stop.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    ss->pv_len = 0;
+    const int ply = ss->ply;
+    // 窓の幅が0でなければ、最善応手列の上にあるノード
+    const bool pv_node = beta - alpha > 2 * ZERO_WINDOW;
+    // 前回の反復の読み筋の上にいるなら、読み筋の指し手を最初に探索する
+    const bool on_pv = follow_pv;
+    const Move pv_move =
+        on_pv && ply < (int)prev_pv.size() ? prev_pv[ply] : Move(Move::NONE);
+
+    // 置換表を引く
+    HASH_KEY key = pos.get_hash_key();
+    bool tt_hit;
+    TTEntry tt_data;
+    TTEntry *tte = TT.probe(key, tt_hit, tt_data);
+    tt_probe_cnt++;
+    tt_hit_cnt += tt_hit;
+    Move tt_move = tt_hit ? tt_data.get_move() : Move(Move::NONE);
+    if (tt_hit && tt_data.get_depth() >= depth) {
+        double tt_score = score_from_tt(tt_data.get_score(), ply);
+        Bound bound = tt_data.get_bound();
+        if (bound == BOUND_EXACT ||
+            (bound == BOUND_LOWER && tt_score >= beta) ||
+            (bound == BOUND_UPPER && tt_score <= alpha)) {
+            tt_cut_cnt++;
+            return tt_score;
+        }
+    }
+
+    const bool in_check = pos.is_check(pos.side_to_move);
+    // 王手されていなければ、枝刈りの判断に使う静的評価値を求めておく
+    const double static_eval = in_check ? -INFTY : evaluate();
+    // 1手前の指し手（null moveの後ならNONE）
+    const Move prev_move = (ss - 1)->current_move;
+
+    // null move pruning：パスして相手に指させても浅い探索でβを超えるなら、
+    // 実際に指せばなおさら超えるはずなのでβカットする
+    // null moveを続けて指すことはしない
+    if (options.null_move && !pv_node && !in_check && depth >= 2 &&
+        static_eval >= beta && beta < MATE_THRESHOLD &&
+        !prev_move.is_none() && null_move_allowed(pos)) {
+        const int reduction = options.null_move_reduction;
+        ss->current_move = Move(Move::NONE);
+        follow_pv = false;
+        (ss + 1)->extension = ss->extension;
+        // パスした局面は実際には現れないので、どの局面とも一致しない値を積む
+        // （2手ごとに同じ手番の局面が並ぶように、何かは積んでおく必要がある）
+        pos.do_null_move();
+        repetitions.push(NULL_MOVE_KEY, false);
+        double value = -search(ss + 1, -beta, -(beta - ZERO_WINDOW),
+                               depth - 1 - reduction);
+        repetitions.pop();
+        pos.undo_null_move();
+        if (stop) {
+            return 0;
+        }
+        if (value >= beta) {
+            // 浅い探索で見つけた詰みは信用しない
+            return value >= MATE_THRESHOLD ? beta : value;
+        }
+    }
+
+    // 1手前の指し手に対するカウンター手
+    const Move counter_move =
+        prev_move.is_none()
+            ? Move(Move::NONE)
+            : counter_moves.get(pos.piece_board[prev_move.get_to()],
+                                prev_move.get_to());
+    // 読み筋の手があればそれを、なければ置換表の最善手を最初に探索する
+    MovePicker mp(pos, !pv_move.is_none() ? pv_move : tt_move, ss->killers,
+                  counter_move, history);
+
+    // futility pruningで読まない手の評価値の見積もり
+    const double futility_value =
+        static_eval + options.futility_margin / 1000.0 * depth;
+    const double alpha_orig = alpha;
+    double best_score = -INFTY;
+    Move best_move = Move(Move::NONE);
+    int legal_cnt = 0;
+    // 探索した駒を捕らない手（βカットのときに履歴を減らす）
+    MoveList quiets;
+
+    Move move;
+    while (!(move = mp.next_move()).is_none()) {
+        const bool is_quiet = move.get_captured_piece() == NO_PIECE;
+        const bool gives_check = !in_check && move.is_check(pos);
+        const bool is_killer =
+            move == ss->killers[0] || move == ss->killers[1];
+        // 王手でも王手回避でもない駒を捕らない手は、局面をあまり変えない
+        const bool is_calm = is_quiet && !in_check && !gives_check;
+
+        // futility pruning：末端に近く、評価値がαに大きく届かないなら、
+        // 駒を捕らない手で挽回するのは難しいので読まない
+        // （1手は読んで、詰まされていないことを確かめてから）
+        if (options.futility && !pv_node && is_calm &&
+            depth <= options.futility_max_depth &&
+            best_score > -MATE_THRESHOLD && futility_value <= alpha) {
+            best_score = std::max(best_score, futility_value);
+            continue;
+        }
+
+        pos.do_move(move);
+        // 対局中に一度訪れた盤面になる手は千日手対策として指さない
+        if (push_position()) {
+            pos.undo_move(move);
+            continue;
+        }
+        legal_cnt++;
+        ss->current_move = move;
+
+        // 王手をかける手と、直前に捕られた駒を取り返す手は、1手に満たない
+        // 延長（1/ONE_PLY手単位）を貯め、1手分に達したら深さを1手延ばす
+        // 延長で探索が終わらなくならないように、rootの深さの2倍までにする
+        int extension = ss->extension;
+        if (ply < 2 * root_depth) {
+            if (gives_check) {
+                extension += options.check_extension;
+            }
+            if (!is_quiet && prev_move.get_captured_piece() != NO_PIECE &&
+                move.get_to() == prev_move.get_to()) {
+                extension += options.recapture_extension;
+            }
+        }
+        (ss + 1)->extension = extension % ONE_PLY;
+        const int new_depth = depth - 1 + extension / ONE_PLY;
+
+        // late move reductions：後ろの方に並んだ手は良い手である見込みが
+        // 低いので、深さを減らして読む（αを超えたら元の深さで読み直す）
+        int reduction = 0;
+        if (options.lmr && is_calm && !is_killer &&
+            depth >= options.lmr_min_depth &&
+            legal_cnt > options.lmr_move_count) {
+            reduction = pv_node || legal_cnt <= 2 * options.lmr_move_count
+                            ? 1
+                            : 2;
+            reduction = std::min(reduction, new_depth - 1);
+        }
+
+        // 子ノードを探索する（follow_pvは子ノードの中で書き換わるので毎回戻す）
+        auto search_child = [&](double a, double b, int d) {
+            follow_pv = on_pv && move == pv_move;
+            return -search(ss + 1, -b, -a, d);
+        };
+        double value = -INFTY;
+        // 探索中の手順で同じ局面に戻ったら、それ以上は読まずに千日手の評価値にする
+        int prev = repetitions.find_repetition();
+        if (prev >= 0) {
+            value = -repetition_score(repetitions.state(prev), ply + 1);
+        } else {
+            // PVS：最初の手以外と深さを減らした手は、αを超えるかどうかだけを
+            // 幅0の窓で調べ、超えたときだけ本来の深さ・窓で読み直す
+            const bool zero_window =
+                reduction > 0 || (options.pvs && legal_cnt > 1);
+            if (zero_window) {
+                value = search_child(alpha, alpha + ZERO_WINDOW,
+                                     new_depth - reduction);
+                if (value > alpha && reduction > 0) {
+                    lmr_research_cnt++;
+                    if (options.pvs) {
+                        value = search_child(alpha, alpha + ZERO_WINDOW,
+                                             new_depth);
+                    }
+                }
+            }
+            if (!zero_window ||
+                (value > alpha && (value < beta || !options.pvs))) {
+                pvs_research_cnt += zero_window;
+                value = search_child(alpha, beta, new_depth);
+            }
+        }
+        pop_position();
+        pos.undo_move(move);
+        // 打ち切られた探索の結果は使わない
+        if (stop) {
+            return 0;
+        }
+        if (is_quiet) {
+            quiets.push_back(move);
+        }
+
+        if (value > best_score) {
+            best_score = value;
+            if (value > alpha) {
+                alpha = value;
+                best_move = move;
+                update_pv(ss, move);
+                // βカット
+                if (alpha >= beta) {
+                    if (is_quiet) {
+                        update_quiet_stats(ss, move, quiets, depth);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    // 指せる手がない（＝詰み）
+    if (legal_cnt == 0) {
+        return mated_in(ply);
+    }
+
+    // 置換表に保存する
+    Bound bound = best_score >= beta        ? BOUND_LOWER
+                  : best_score > alpha_orig ? BOUND_EXACT
+                                            : BOUND_UPPER;
+    tte->save(key, score_to_tt(best_score, ply), bound, depth, best_move,
+              TT.generation());
+
+    return best_score;
+}
+
+double Searcher::qsearch(Stack *ss, double alpha, double beta, int depth) {
+    uint64_t n = nodes.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (n % CHECK_TIME_INTERVAL == 0) {
+        check_time();
+    }
+    if (stop.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    ss->pv_len = 0;
+    const int ply = ss->ply;
+    if (ply >= MAX_PLY) {
+        return evaluate();
+    }
+
+    const bool in_check = pos.is_check(pos.side_to_move);
+    double best_score = -INFTY;
+    double stand_pat = -INFTY;
+    MoveList move_list;
+    if (in_check) {
+        // 王手されていたら全ての手で受ける（受けがなければ詰み）
+        generate_legal_moves(pos, move_list);
+        if (move_list.empty()) {
+            return mated_in(ply);
+        }
+    } else {
+        // 王手されていなければ、何もしない（＝今の評価値で止める）こともできる
+        stand_pat = evaluate();
+        if (stand_pat >= beta) {
+            return stand_pat;
+        }
+        alpha = std::max(alpha, stand_pat);
+        best_score = stand_pat;
+        generate_legal_moves(pos, move_list, GEN_CAPTURES);
+        // 王手は静止探索の最初の手だけ読む
+        if (depth == 0) {
+            generate_quiet_checks(pos, move_list);
+        }
+    }
+    sort_move_list(move_list, pos);
+
+    for (auto move : move_list) {
+        // デルタ枝刈り：駒を丸得しても、αに届かない手は読まない
+        Piece captured = move.get_captured_piece();
+        if (!in_check && captured != NO_PIECE &&
+            stand_pat + eval_capture_gain(pos, captured) + DELTA_MARGIN <=
+                alpha) {
+            continue;
+        }
+        pos.do_move(move);
+        if (push_position()) {
+            pos.undo_move(move);
+            continue;
+        }
+        ss->current_move = move;
+        int prev = repetitions.find_repetition();
+        double value =
+            prev >= 0 ? -repetition_score(repetitions.state(prev), ply + 1)
+                      : -qsearch(ss + 1, -beta, -alpha, depth - 1);
+        pop_position();
+        pos.undo_move(move);
+        if (stop) {
+            return 0;
+        }
+
+        if (value > best_score) {
+            best_score = value;
+            if (value > alpha) {
+                alpha = value;
+                update_pv(ss, move);
+                if (alpha >= beta) {
+                    break;
+                }
+            }
+        }
+    }
+
+    // 王手の受けが全て対局中の局面に戻る手だった
+    if (best_score == -INFTY) {
+        return mated_in(ply);
+    }
+    return best_score;
+}
+
+void Searcher::update_quiet_stats(Stack *ss, Move move, const MoveList &quiets,
+                                  int depth) {
+    if (ss->killers[0] != move) {
+        ss->killers[1] = ss->killers[0];
+        ss->killers[0] = move;
+    }
+    const Move prev_move = (ss - 1)->current_move;
+    if (!prev_move.is_none()) {
+        counter_moves.set(pos.piece_board[prev_move.get_to()],
+                          prev_move.get_to(), move);
+    }
+    // 深い探索でのβカットほど大きく加点し、先に試して失敗した手は減点する
+    const Color us = pos.side_to_move;
+    const int bonus = std::min(depth * depth, HISTORY_MAX);
+    history.update(us, move, bonus);
+    for (auto m : quiets) {
+        if (m != move) {
+            history.update(us, m, -bonus);
+        }
+    }
+}
+
+// 持ち時間を使い切りそうか、stopコマンドが来ていれば探索を打ち切る
+// 最低でも深さ1の探索は終わらせる
+// 時間を見るのはメインスレッドだけで、ヘルパーはstopを見て止まる
+void Searcher::check_time() {
+    if (thread_id != 0 || time_manager == nullptr || root_depth <= 1) {
+        return;
+    }
+    if (time_manager->stop_requested() ||
+        (time_manager->enabled() &&
+         time_manager->elapsed() >= time_manager->maximum())) {
+        stop = true;
+    }
+}
+
+// 手番側から見た評価値を返す（-0.5 ~ 0.5）
+// 先後で符号が反転するように、駒の価値の割合（またはNNUEの勝率）から0.5を引いている
+double Searcher::evaluate() {
+    if (NNUE::is_loaded()) {
+        return NNUE::evaluate(pos) - 0.5;
+    }
+    return eval_pieces(pos, pos.side_to_move) - 0.5;
+}
+
+// 現在の局面をrepetitionsに積み、対局中に一度現れた局面かどうかを返す
+// 対局中の局面だった場合は、積んだ局面を降ろしておく
+bool Searcher::push_position() {
+    repetitions.push(pos.get_hash_key(), pos.is_check(pos.side_to_move));
+    int prev = repetitions.find_repetition();
+    if (prev >= 0 && prev < game_ply) {
+        repetitions.pop();
+        return true;
+    }
+    return false;
+}
+
+// 読み筋を「move + 1つ先のplyの読み筋」に更新する
+void Searcher::update_pv(Stack *ss, Move move) {
+    ss->pv[0] = move;
+    std::copy((ss + 1)->pv, (ss + 1)->pv + (ss + 1)->pv_len, ss->pv + 1);
+    ss->pv_len = (ss + 1)->pv_len + 1;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "../common/nnue.h"
+#include "../common/position.h"
+#include "../common/repetition.h"
+#include "../common/timeman.h"
+#include "movepick.h"
+#include "params.h"
+#include <atomic>
+#include <vector>
+
+// 探索中の1手ごとの情報（rootから順にplyの数だけ積まれる）
+struct Stack {
+    int ply = 0; // rootからの手数
+    // このplyで探索中の指し手
+    Move current_move = Move(Move::NONE);
+    // このplyでβカットを起こした駒を捕らない手（新しい順に2つ）
+    Move killers[2] = {Move(Move::NONE), Move(Move::NONE)};
+    // rootからこのノードまでに貯まった、1手に満たない延長（1/ONE_PLY手単位）
+    int extension = 0;
+    // このplyからの読み筋
+    Move pv[MAX_PLY + 1];
+    int pv_len = 0;
+};
+
+// rootの指し手と、その評価値・読み筋
+struct RootMove {
+    Move move;
+    double score = -INFTY;
+    std::vector<Move> pv;
+
+    RootMove(Move m) : move(m) {}
+    // 評価値の高い順に並べる
+    bool operator<(const RootMove &rm) const { return rm.score < score; }
+};
+
+// 探索の枝刈りの設定（USIのsetoptionで変更して、強さを調整する）
+struct SearchOptions {
+    // 最初の手以外は幅0の窓で読み、αを超えたときだけ読み直す
+    bool pvs = true;
+    // パスしても浅い探索でβを超えるならβカットする
+    bool null_move = true;
+    int null_move_reduction = NULL_MOVE_REDUCTION;
+    // 後ろの方に並んだ駒を捕らない手は、深さを減らして読む
+    bool lmr = true;
+    int lmr_min_depth = LMR_MIN_DEPTH;
+    int lmr_move_count = LMR_MOVE_COUNT;
+    // 末端に近いノードで、評価値が大きく足りない駒を捕らない手は読まない
+    bool futility = true;
+    int futility_max_depth = FUTILITY_MAX_DEPTH;
+    int futility_margin = FUTILITY_MARGIN; // 評価値の1000倍
+    // 前回の反復の評価値の周りの狭い窓でrootを探索する
+    bool aspiration = true;
+    int aspiration_delta = ASPIRATION_DELTA; // 評価値の1000倍
+    // 王手・取り返しの延長（1/ONE_PLY手単位）
+    int check_extension = CHECK_EXTENSION;
+    int recapture_extension = RECAPTURE_EXTENSION;
+};
+
+// 1つの局面を、指し手の実行と巻き戻しを繰り返しながら探索するクラス
+// Lazy SMPでは1スレッドにつき1つ作り、置換表と停止フラグだけを共有する
+class Searcher {
+  public:
+    // thread_idが0のものがメインスレッドで、時間の管理も行う
+    Searcher(const Position &pos, std::atomic<bool> &stop, int thread_id = 0,
+             const TimeManager *time_manager = nullptr,
+             const SearchOptions &options = SearchOptions());
+
+    // rootの全ての合法手をdepthまで探索して、root_movesに評価値を書き込む
+    // 時間切れで探索を打ち切った場合はfalseを返す（root_movesは信用できない）
+    bool search_root(int depth);
+    // ヘルパースレッド用の反復深化。stopが立つまで探索を続ける。
+    void helper_loop();
+
+    std::vector<RootMove> root_moves;
+    // 探索したノード数（他のスレッドから集計のために読まれる）
+    std::atomic<uint64_t> nodes{0};
+    // 置換表の統計情報
+    uint64_t tt_probe_cnt = 0; // 置換表を引いた回数
+    uint64_t tt_hit_cnt = 0;   // エントリーが見つかった回数
+    uint64_t tt_cut_cnt = 0;   // 置換表の評価値で探索を打ち切った回数
+    // 探索し直した回数の統計情報
+    uint64_t aspiration_fail_high_cnt = 0; // rootの評価値が窓の上に出た回数
+    uint64_t aspiration_fail_low_cnt = 0;  // rootの評価値が窓の下に出た回数
+    uint64_t pvs_research_cnt = 0; // 幅0の窓でαを超え、窓を戻して読み直した回数
+    uint64_t lmr_research_cnt = 0; // 深さを減らした手がαを超えた回数
+
+  private:
+    // rootの全ての合法手をalphaとbetaの窓で探索して、最も高い評価値を返す
+    // betaを超える手が見つかったら、その手を先頭に移して打ち切る
+    double search_root_moves(int depth, double alpha, double beta);
+    double search(Stack *ss, double alpha, double beta, int depth);
+    // 駒を捕る手（depthが0なら王手も）だけを読む静止探索
+    double qsearch(Stack *ss, double alpha, double beta, int depth);
+    double evaluate();
+    // 指し手を実行した直後の局面を積み、対局中に現れた局面の繰り返しならtrueを返す
+    // （そのときは積んだ局面を降ろしてある）
+    bool push_position();
+    void pop_position() { repetitions.pop(); }
+    void update_pv(Stack *ss, Move move);
+    // βカットを起こした駒を捕らない手を、キラー手・カウンター手・履歴に記録する
+    void update_quiet_stats(Stack *ss, Move move, const MoveList &quiets,
+                            int depth);
+    void check_time();
+
+    Position pos;
+    Stack stack[MAX_PLY + 2];
+    std::atomic<bool> &stop; // trueになったら探索を打ち切る（全スレッド共通）
+    const int thread_id;
+    const TimeManager *time_manager;
+    const SearchOptions options;
+    int root_depth = 0;
+    // 前回の反復の読み筋。この手順を最初に探索する。
+    std::vector<Move> prev_pv;
+    // 今探索しているノードが前回の読み筋の上にあるかどうか
+    bool follow_pv = false;
+    // NNUEを使う場合のアキュムレータ（posのdo_move / undo_moveで積み降ろしされる）
+    NNUE::AccumulatorStack nnue_stack;
+    // 対局中の局面と、探索中の手順の局面（千日手の判定に使う）
+    RepetitionStack repetitions;
+    // repetitionsのうち、対局中の局面の数
+    int game_ply = 0;
+    // 指し手の並べ替えに使う履歴（反復をまたいで引き継ぐ）
+    ButterflyHistory history;
+    CounterMoveHistory counter_moves;
+};
+
+// plyで詰ませる / 詰まされるときの評価値
+inline double mate_in(int ply) { return MATE_SCORE - ply; }
+inline double mated_in(int ply) { return -MATE_SCORE + ply; }
+
+// 探索中の手順で千日手になった局面の評価値（その局面の手番側から見たもの）
+// 連続王手の千日手は、王手をかけ続けた側の負けとする
+inline double repetition_score(RepetitionState state, int ply) {
+    return state == REPETITION_WIN    ? mate_in(ply)
+           : state == REPETITION_LOSE ? mated_in(ply)
+                                      : 0.0;
+}
+
+// 詰みの評価値はrootからの手数に依存するので、
+// 置換表には「そのノードからの手数」に直して保存する
+inline double score_to_tt(double score, int ply) {
+    return score >= MATE_THRESHOLD    ? score + ply
+           : score <= -MATE_THRESHOLD ? score - ply
+                                      : score;
+}
+inline double score_from_tt(double score, int ply) {
+    return score >= MATE_THRESHOLD    ? score - ply
+           : score <= -MATE_THRESHOLD ? score + ply
+                                      : score;
+}
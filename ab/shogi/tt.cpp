@@ -0,0 +1,95 @@
+#include "tt.h"
+#include <algorithm>
+#include <cstring>
+
+TranspositionTable TT;
+
+void TTEntry::save(HASH_KEY key, double score, Bound bound, int depth,
+                   Move move, uint8_t generation) {
+    uint32_t k = (uint32_t)(key >> 32);
+    bool same = (key32 ^ checksum()) == k;
+    // 同じ局面で最善手が得られていない場合は、以前の最善手を残す
+    if (!move.is_none() || !same) {
+        this->move = move.value;
+    }
+    // 別の局面か、より深い探索結果か、正確な評価値なら上書きする
+    if (!same || bound == BOUND_EXACT || depth >= this->depth - 2 ||
+        get_generation() != generation) {
+        this->score = score;
+        this->depth = (int8_t)depth;
+        this->genbound = (uint8_t)(generation | bound);
+    }
+    this->key32 = k ^ checksum();
+}
+
+void TranspositionTable::resize(size_t mb_size) {
+    size_t cluster_cnt = mb_size * 1024 * 1024 / sizeof(TTCluster);
+    // インデックスをマスクで求められるように2の累乗に切り下げる
+    size_t pow2 = 1;
+    while (pow2 * 2 <= cluster_cnt) {
+        pow2 *= 2;
+    }
+    table.assign(pow2, TTCluster());
+    cluster_mask = pow2 - 1;
+    clear();
+}
+
+void TranspositionTable::clear() {
+    if (!table.empty()) {
+        std::memset(table.data(), 0, table.size() * sizeof(TTCluster));
+    }
+    generation8 = 0;
+}
+
+void TranspositionTable::new_search() {
+    // 下位2bitはBoundに使うので4ずつ進める
+    generation8 += 4;
+}
+
+TTEntry *TranspositionTable::probe(HASH_KEY key, bool &found,
+                                   TTEntry &data) {
+    // 下位ビットでクラスタを、上位32bitでエントリーを識別する
+    TTEntry *entries = table[key & cluster_mask].entry;
+    uint32_t k = (uint32_t)(key >> 32);
+
+    for (int i = 0; i < CLUSTER_SIZE; ++i) {
+        // 他のスレッドが書き込み中でも、コピーしてから検証すれば壊れた
+        // データを使うことはない
+        data = entries[i];
+        if ((data.key32 ^ data.checksum()) == k) {
+            // 見つかったエントリーは今回の探索でも使われたことにする
+            entries[i].genbound = (uint8_t)(generation8 | data.get_bound());
+            found = true;
+            return &entries[i];
+        }
+    }
+
+    // 見つからなかった場合は「浅くて古い」エントリーを置き換え先にする
+    TTEntry *replace = &entries[0];
+    auto worth = [this](const TTEntry &e) {
+        int relative_age = (256 + generation8 - e.get_generation()) & 0xFC;
+        return e.depth - relative_age / 2;
+    };
+    for (int i = 1; i < CLUSTER_SIZE; ++i) {
+        if (worth(entries[i]) < worth(*replace)) {
+            replace = &entries[i];
+        }
+    }
+    found = false;
+    return replace;
+}
+
+int TranspositionTable::hashfull() const {
+    // 先頭の1000クラスタだけをサンプリングする
+    int cnt = 0;
+    size_t n = std::min<size_t>(1000, table.size());
+    for (size_t i = 0; i < n; ++i) {
+        for (int j = 0; j < CLUSTER_SIZE; ++j) {
+            const TTEntry &e = table[i].entry[j];
+            if (e.key32 != 0 && e.get_generation() == generation8) {
+                cnt++;
+            }
+        }
+    }
+    return n == 0 ? 0 : (int)(cnt * 1000 / (n * CLUSTER_SIZE));
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../common/movegen.h"
+#include "../common/shogi.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// 置換表に保存する評価値の種類
+enum Bound : uint8_t {
+    BOUND_NONE,  // 評価値は使えない（指し手のみ有効）
+    BOUND_UPPER, // 真の評価値はこれ以下
+    BOUND_LOWER, // 真の評価値はこれ以上（βカットが起きた）
+    BOUND_EXACT, // 真の評価値そのもの
+};
+
+// 置換表のエントリー（16byte）
+// 評価値は「そのノードの手番側から見た評価値」を保存する
+// 探索はZERO_WINDOWのような非常に狭い窓を使うので、評価値は丸めずにdoubleで持つ
+// 複数スレッドからロックなしで読み書きするので、key32には
+// 「ハッシュキーの上位32bit ^ データのチェックサム」を保存しておき、
+// 書き込み途中のエントリーを読んでしまった場合はキーの不一致として検出する
+struct TTEntry {
+    double score;     // 評価値
+    uint32_t key32;   // ハッシュキーの上位32bit ^ checksum()
+    uint16_t move;    // 最善手
+    int8_t depth;     // 残り探索深さ
+    uint8_t genbound; // 上位6bit:世代, 下位2bit:Bound
+
+    Move get_move() const {
+        Move m;
+        m.value = move;
+        return m;
+    }
+    double get_score() const { return score; }
+    int get_depth() const { return depth; }
+    Bound get_bound() const { return (Bound)(genbound & 0x3); }
+    uint8_t get_generation() const { return genbound & ~0x3; }
+    // 世代以外のデータから作るチェックサム
+    // 世代はprobe()で書き換えるので含めない
+    uint32_t checksum() const {
+        uint64_t s;
+        std::memcpy(&s, &score, sizeof(s));
+        return (uint32_t)s ^ (uint32_t)(s >> 32) ^ move ^ ((uint32_t)(uint8_t)depth << 16) ^
+               ((uint32_t)get_bound() << 24);
+    }
+
+    void save(HASH_KEY key, double score, Bound bound, int depth, Move move,
+              uint8_t generation);
+};
+
+// 1クラスタ＝キャッシュライン1本分（64byte）にエントリーを詰め込む
+constexpr int CLUSTER_SIZE = 4;
+struct alignas(64) TTCluster {
+    TTEntry entry[CLUSTER_SIZE];
+};
+static_assert(sizeof(TTEntry) == 16, "TTEntry must be 16 bytes");
+static_assert(sizeof(TTCluster) == 64, "TTCluster must be 64 bytes");
+
+class TranspositionTable {
+  public:
+    // 置換表のサイズをMB単位で変更する。中身はクリアされる。
+    void resize(size_t mb_size);
+    void clear();
+    // 探索開始時に呼ぶ。世代を進めて古いエントリーを置き換えやすくする。
+    void new_search();
+    // keyに対応するエントリーを返す。見つからなければ置き換え先のエントリーを返す。
+    // 他のスレッドに書き換えられても困らないように、見つかったエントリーの
+    // 中身はdataにコピーして返す
+    TTEntry *probe(HASH_KEY key, bool &found, TTEntry &data);
+    uint8_t generation() const { return generation8; }
+    // 置換表の使用率（千分率）
+    int hashfull() const;
+
+  private:
+    std::vector<TTCluster> table;
+    size_t cluster_mask = 0;
+    uint8_t generation8 = 0;
+};
+
+extern TranspositionTable TT;
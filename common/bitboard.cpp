@@ -20,10 +20,15 @@ uint16_t BETWEEN_INDEX[SQ_NB][SQ_NB];
 Bitboard FILE_BB[FILE_NB]; // 各筋の全ビットが1のBitboard
 Bitboard PROMOTE_ZONE[COLOR_NB]; // [BLACK]なら、先手が成れる場所のBitboard
 
-HASH_KEY Bitboards::occ[SQ_NB];
-HASH_KEY Bitboards::square[SQ_NB];
-std::unordered_map<HASH_KEY, Bitboard> Bitboards::hash_rook_effect;
-std::unordered_map<HASH_KEY, Bitboard> Bitboards::hash_bishop_effect;
+Magic BISHOP_MAGICS[SQ_NB];
+Magic ROOK_MAGICS[SQ_NB];
+Bitboard BISHOP_EFFECT_TABLE[BISHOP_TABLE_SIZE];
+Bitboard ROOK_EFFECT_TABLE[ROOK_TABLE_SIZE];
+
+static Bitboard calc_bishop_effect(Square sq, Bitboard occ);
+static Bitboard calc_rook_effect(Square sq, Bitboard occ);
+static void init_magics(Magic magics[], Bitboard table[], bool is_bishop,
+                        std::mt19937_64 &mt);
 
 unsigned ctz(unsigned x) {
     if (x == 0)
@@ -390,41 +395,142 @@ void Bitboards::init() {
     //        "between_index == BETWEEN_INDEX_SIZE");
 
     // --------------------
-    //   ハッシュキーの初期化
+    //   飛車・角の利きテーブルの初期化
     // --------------------
-    std::mt19937 mt;
-    mt.seed(20231024);
+    std::mt19937_64 mt(20231024);
+    init_magics(BISHOP_MAGICS, BISHOP_EFFECT_TABLE, true, mt);
+    init_magics(ROOK_MAGICS, ROOK_EFFECT_TABLE, false, mt);
+}
 
-    // Squareの乱数表の初期化
-    for (Square sq = SQ_ZERO; sq < SQ_NB; ++sq) {
-        uint64_t r = (((uint64_t)mt() << 32) | (uint64_t)mt());
-        Bitboards::square[sq] = r;
-    }
+// 全ての升について、あり得る全ての駒の配置に対する利きをテーブルに書き込む
+static void init_magics(Magic magics[], Bitboard table[], bool is_bishop,
+                        std::mt19937_64 &mt) {
+    Bitboard occupancy[256], reference[256];
+    int epoch[256] = {}, cnt = 0;
+    size_t offset = 0;
 
-    // 駒の配置の乱数表の初期化
     for (Square sq = SQ_ZERO; sq < SQ_NB; ++sq) {
-        uint64_t r = (((uint64_t)mt() << 32) | (uint64_t)mt());
-        Bitboards::occ[sq] = r;
-    }
+        Magic &m = magics[sq];
+        m.mask = is_bishop ? BISHOP_EFFECT_BB[sq][DIRECTION_X]
+                           : ROOK_EFFECT_BB[sq][DIRECTION_CROSS];
+        int bits = 0;
+        for (uint32_t b = m.mask.p; b != 0; b &= b - 1) {
+            ++bits;
+        }
+        int size = 1 << bits;
+        m.shift = 64 - bits;
+        m.effects = table + offset;
+        offset += size;
+
+        // maskの部分集合を全て列挙して（Carry-Rippler法）、利きを計算しておく
+        uint32_t b = 0;
+        for (int i = 0; i < size; ++i) {
+            occupancy[i] = Bitboard(b);
+            reference[i] = is_bishop ? calc_bishop_effect(sq, b)
+                                     : calc_rook_effect(sq, b);
+#ifdef USE_BMI2
+            m.effects[m.index(occupancy[i])] = reference[i];
+#endif
+            b = (b - m.mask.p) & m.mask.p;
+        }
 
-    // --------------------
-    //   ハッシュマップの初期化
-    // --------------------
+#ifndef USE_BMI2
+        // 異なる利きが同じインデックスに衝突しないmagic numberを乱数で探す
+        for (int i = 0; i < size;) {
+            m.magic = mt() & mt() & mt(); // ビットが疎な乱数の方が見つかりやすい
+            ++cnt;
+            for (i = 0; i < size; ++i) {
+                uint32_t idx = m.index(occupancy[i]);
+                if (epoch[idx] < cnt) {
+                    epoch[idx] = cnt;
+                    m.effects[idx] = reference[i];
+                } else if (!(m.effects[idx] == reference[i])) {
+                    break;
+                }
+            }
+        }
+#endif
+    }
+    // ASSERT(offset == (is_bishop ? BISHOP_TABLE_SIZE : ROOK_TABLE_SIZE),
+    //        "table size is invalid");
+}
 
-    std::unordered_map<Square, Bitboard> bishop_effect_hash;
-    std::unordered_map<Square, Bitboard> rook_effect_hash;
-    bishop_effect_hash.reserve(BISHOP_TABLE_SIZE);
-    rook_effect_hash.reserve(ROOK_TABLE_SIZE);
+// 角の利きを計算する（テーブルの初期化用）
+static Bitboard calc_bishop_effect(Square sq, Bitboard occ) {
+    occ &= BISHOP_EFFECT_BB[sq][DIRECTION_X];
+
+    // 右上方向
+    Bitboard mask = BISHOP_EFFECT_BB[sq][DIRECTION_UPPER_RIGHT];
+    Bitboard upper_right = mask & occ;             // マスク
+    upper_right = reverse_bitboard(upper_right.p); // 逆転
+    Bitboard minus_one = upper_right.p - 1;        // 1を引く
+    upper_right ^= minus_one;                      // 1を引いたものとXOR
+    upper_right = reverse_bitboard(upper_right.p); // 逆転
+    upper_right &= mask;                           // 再度マスクをかける
+
+    // 右下方向
+    mask = BISHOP_EFFECT_BB[sq][DIRECTION_LOWER_RIGHT];
+    Bitboard lower_right = mask & occ;
+    lower_right = reverse_bitboard(lower_right.p);
+    minus_one = lower_right.p - 1;
+    lower_right ^= minus_one;
+    lower_right = reverse_bitboard(lower_right.p);
+    lower_right &= mask;
+
+    // 左下方向
+    mask = BISHOP_EFFECT_BB[sq][DIRECTION_LOWER_LEFT];
+    Bitboard lower_left = mask & occ;
+    minus_one = lower_left.p - 1;
+    lower_left ^= minus_one;
+    lower_left &= mask;
+
+    // 左上方向
+    mask = BISHOP_EFFECT_BB[sq][DIRECTION_UPPER_LEFT];
+    Bitboard upper_left = mask & occ;
+    minus_one = upper_left.p - 1;
+    upper_left ^= minus_one;
+    upper_left &= mask;
+
+    return upper_right | lower_right | lower_left | upper_left;
 }
 
-HASH_KEY Bitboards::h(Square sq, Bitboard occ) {
-    HASH_KEY key = 0;
-    key ^= Bitboards::square[sq];
-    while (occ.p != 0) {
-        Square s = occ.pop();
-        key ^= Bitboards::occ[s];
-    }
-    return key;
+// 飛車の利きを計算する（テーブルの初期化用）
+static Bitboard calc_rook_effect(Square sq, Bitboard occ) {
+    occ &= ROOK_EFFECT_BB[sq][DIRECTION_CROSS];
+
+    // 右方向
+    Bitboard mask = ROOK_EFFECT_BB[sq][DIRECTION_RIGHT];
+    Bitboard right = mask & occ;
+    right = reverse_bitboard(right.p);
+    Bitboard minus_one = right.p - 1;
+    right ^= minus_one;
+    right = reverse_bitboard(right.p);
+    right &= mask;
+
+    // 上方向
+    mask = ROOK_EFFECT_BB[sq][DIRECTION_UP];
+    Bitboard up = mask & occ;
+    up = reverse_bitboard(up.p);
+    minus_one = up.p - 1;
+    up ^= minus_one;
+    up = reverse_bitboard(up.p);
+    up &= mask;
+
+    // 左方向
+    mask = ROOK_EFFECT_BB[sq][DIRECTION_LEFT];
+    Bitboard left = mask & occ;
+    minus_one = left.p - 1;
+    left ^= minus_one;
+    left &= mask;
+
+    // 下方向
+    mask = ROOK_EFFECT_BB[sq][DIRECTION_DOWN];
+    Bitboard down = mask & occ;
+    minus_one = down.p - 1;
+    down ^= minus_one;
+    down &= mask;
+
+    return right | down | left | up;
 }
 
 // ビットを逆順にする
@@ -4,7 +4,9 @@
 #include <cstdint> // uint8_t, uint16_tなどの型を使えるようにする
 #include <iostream>
 #include <map>
-#include <unordered_map> // ハッシュテーブル用
+#ifdef USE_BMI2
+#include <immintrin.h> // _pext_u32
+#endif
 
 unsigned ctz(unsigned x);
 
@@ -68,20 +70,47 @@ struct Bitboard {
     friend std::ostream &operator<<(std::ostream &os, const Bitboard &bb);
 };
 
+// 飛車・角の利きテーブルのサイズ
+// 各升について 2^(利きの升の数) 通りの駒の配置があり、その総和がこの値になる
 #define BISHOP_TABLE_SIZE 1024
 #define ROOK_TABLE_SIZE 6400
 
 namespace Bitboards {
 void init();
-HASH_KEY h(Square sq, Bitboard occ);
-// sqに駒がある状態を表す
-extern HASH_KEY occ[SQ_NB];
-// sqについて利きを計算することを表す
-extern HASH_KEY square[SQ_NB];
-extern std::unordered_map<HASH_KEY, Bitboard> hash_rook_effect;
-extern std::unordered_map<HASH_KEY, Bitboard> hash_bishop_effect;
 }; // namespace Bitboards
 
+// 飛車・角の利きテーブルを引くための情報（升ごとに1つ）
+// 利きに影響する升の駒の配置(occ & mask)を、テーブルのインデックスに変換する。
+// BMI2が使える場合はPEXT命令、そうでない場合はmagic numberの掛け算で変換する。
+struct Magic {
+    Bitboard mask;     // 利きに影響する升
+    uint64_t magic;    // magic number（PEXTを使わない場合）
+    uint32_t shift;    // 64 - (maskのビット数)
+    Bitboard *effects; // この升の利きテーブルの先頭
+
+    uint32_t index(Bitboard occ) const {
+#ifdef USE_BMI2
+        return _pext_u32(occ.p, mask.p);
+#else
+        return (uint32_t)(((uint64_t)(occ.p & mask.p) * magic) >> shift);
+#endif
+    }
+    Bitboard effect(Bitboard occ) const { return effects[index(occ)]; }
+};
+
+extern Magic BISHOP_MAGICS[SQ_NB];
+extern Magic ROOK_MAGICS[SQ_NB];
+extern Bitboard BISHOP_EFFECT_TABLE[BISHOP_TABLE_SIZE];
+extern Bitboard ROOK_EFFECT_TABLE[ROOK_TABLE_SIZE];
+
+// 盤上の駒の配置がoccのときの、sqにある角・飛車の利き
+inline Bitboard bishop_effect_bb(Square sq, Bitboard occ) {
+    return BISHOP_MAGICS[sq].effect(occ);
+}
+inline Bitboard rook_effect_bb(Square sq, Bitboard occ) {
+    return ROOK_MAGICS[sq].effect(occ);
+}
+
 extern Bitboard PAWN_EFFECT_BB[SQ_NB][COLOR_NB];       // 歩の利き
 extern Bitboard GOLD_EFFECT_BB[SQ_NB][COLOR_NB];       // 金の利き
 extern Bitboard SILVER_EFFECT_BB[SQ_NB][COLOR_NB];     // 銀の利き
@@ -1,10 +1,31 @@
 #include "../common/bitboard.h"
 #include "../common/zobrist.h"
+#include "perft.h"
 #include "usi.h"
+#include <exception>
+#include <iostream>
+#include <string>
 
 int main(int argc, char **argv) {
     Bitboards::init();
     Zobrist::init();
+
+    // shogi-engine bench [depth] で指し手生成のベンチマークだけを実行する
+    if (argc >= 2 && std::string(argv[1]) == "bench") {
+        int depth = BENCH_DEPTH;
+        try {
+            depth = argc >= 3 ? std::stoi(argv[2]) : BENCH_DEPTH;
+        } catch (const std::exception &) {
+            std::cout << "invalid depth: " << argv[2] << std::endl;
+            return 1;
+        }
+        return bench(depth) ? 0 : 1;
+    }
+    // shogi-engine nncheck でプレイアウトのモデルの推論結果を検証する
+    if (argc >= 2 && std::string(argv[1]) == "nncheck") {
+        return Root().check_network() ? 0 : 1;
+    }
+
     USI usi = USI();
     usi.loop();
 
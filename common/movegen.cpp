@@ -1,6 +1,5 @@
 #include "movegen.h"
-
-Move::Move() { value = NONE; }
+#include <algorithm>
 
 Move::Move(MoveType move_type) { value = move_type; }
 
@@ -50,23 +49,22 @@ int sq_to_index(const std::string &sq) {
 }
 
 // 盤面情報を受け取り、手番側の指し手のリストを返す関数
-std::vector<Move> generate_move_list(Position &pos) {
-    std::vector<Move> move_list; // 指し手のリスト
-    move_list = generate_move_list(pos, move_list);
+MoveList generate_move_list(Position &pos) {
+    MoveList move_list; // 指し手のリスト
+    generate_move_list(pos, move_list);
     for (auto &m : move_list) {
         pos.set_captured_piece(m);
     }
     return move_list;
 }
 
-std::vector<Move> generate_move_list(Position &pos,
-                                     std::vector<Move> &move_list) {
+void generate_move_list(Position &pos, MoveList &move_list) {
     Color us = pos.side_to_move; // 手番側の色
 
     // 自玉が不在なら投了
     // 本来は必要ない関数だが、GUIが玉の不在を検知できない場合があるので念のため
     if (pos.piece_bitboards[KING + us * PIECE_WHITE].p == 0) {
-        return move_list;
+        return;
     }
 
     // 敵玉を捕れる手があるならそれを返す
@@ -74,7 +72,7 @@ std::vector<Move> generate_move_list(Position &pos,
     // NONE以外が返ってきたらそれを返す
     if (m != Move(Move::NONE)) {
         move_list.push_back(m);
-        return move_list;
+        return;
     }
 
     // 自玉に王手がかかっているなら王手回避
@@ -84,34 +82,261 @@ std::vector<Move> generate_move_list(Position &pos,
         // 玉以外の駒で王手を防ぐ指し手を生成
         // 合駒で防ぐ手も含まれる
         generate_block_moves(us, move_list, pos);
-        return move_list;
+        return;
     }
 
     generate_moves(us, move_list, pos); // 駒打ち以外の指し手を生成
     generate_drop_moves(us, move_list, pos); // 駒打ちの指し手を生成
+}
 
+// 盤面情報を受け取り、手番側の合法手のリストを返す関数
+MoveList generate_legal_moves(Position &pos) {
+    MoveList move_list;
+    generate_legal_moves(pos, move_list);
     return move_list;
 }
 
-void sort_move_list(std::vector<Move> &move_list, Position &pos) {
-    int idx = 0;
-    // 指し手のリストで、敵の駒を捕る手が手前側にくるようにソートする
-    for (int i = 0; i < move_list.size(); ++i) {
+// 王手している駒とピンされている駒を最初に1度だけ求めて、合法手だけを生成する
+// 指し手の順番はgenerate_move_list()と同じにしてある
+void generate_legal_moves(Position &pos, MoveList &move_list) {
+    generate_legal_moves(pos, move_list, GEN_ALL);
+}
+
+// typeの種類の合法手だけを生成して、move_listの末尾に追加する
+void generate_legal_moves(Position &pos, MoveList &move_list, GenType type) {
+    Color us = pos.side_to_move;
+    if (pos.piece_bitboards[KING + us * PIECE_WHITE].p == 0) {
+        return;
+    }
+    const int begin = move_list.size();
+    Square king_sq = pos.king_square(us);
+    Bitboard occupied = pos.occupied_bb(COLOR_ALL);
+    Bitboard checkers = pos.attackers_to(~us, king_sq, occupied);
+    // 盤上の駒の移動先と、駒打ちをするかどうか
+    Bitboard target = type == GEN_CAPTURES ? pos.occupied_bb(~us)
+                      : type == GEN_QUIETS ? ~occupied
+                      : type == GEN_DROPS  ? Bitboard(0)
+                                           : Bitboard(0xFFFFFFFF);
+    const bool with_drops = type == GEN_DROPS || type == GEN_ALL;
+
+    if (checkers.p == 0) {
+        generate_moves(us, move_list, target, pos);
+        if (with_drops) {
+            generate_drop_moves(us, move_list, pos);
+        }
+    } else {
+        // 玉の指し手は、生成の時点で敵の利きのない場所に限っている
+        generate_piece_moves<KING>(us, move_list, target, pos);
+        // 両王手でなければ、合駒と、王手している駒を捕る手・間に入る手
+        if ((checkers.p & (checkers.p - 1)) == 0) {
+            Square checker_sq = static_cast<Square>(ctz(checkers.p));
+            Bitboard between_bb = get_between_bb(checker_sq, king_sq);
+            if (with_drops) {
+                generate_drop_moves(us, between_bb, move_list, pos);
+            }
+            target &= between_bb | checkers;
+            generate_piece_moves<PAWN>(us, move_list, target, pos);
+            generate_piece_moves<SILVER>(us, move_list, target, pos);
+            generate_piece_moves<GOLD>(us, move_list, target, pos);
+            generate_piece_moves<BISHOP>(us, move_list, target, pos);
+            generate_piece_moves<ROOK>(us, move_list, target, pos);
+            generate_piece_moves<PRO_PAWN>(us, move_list, target, pos);
+            generate_piece_moves<PRO_SILVER>(us, move_list, target, pos);
+            generate_piece_moves<HORSE>(us, move_list, target, pos);
+            generate_piece_moves<DRAGON>(us, move_list, target, pos);
+        }
+    }
+
+    // ピンされている駒は、玉と敵の飛び駒を結ぶ線の上でしか動けない
+    // 歩を打つ手は打ち歩詰めでないかを調べる
+    // （玉の指し手と、歩以外の駒打ちはこの時点で全て合法）
+    Bitboard pinned = pinned_pieces(us, pos);
+    const int end = move_list.size();
+    int cnt = begin;
+    for (int i = begin; i < end; ++i) {
         Move m = move_list[i];
+        Square to = m.get_to();
         if (m.is_drop()) {
-            continue;
+            if (m.get_dropped_piece() == PAWN && is_pawn_drop_mate(to, pos)) {
+                continue;
+            }
+        } else {
+            Square from = m.get_from();
+            if (pinned.check_bit(from) &&
+                !get_between_bb(king_sq, to).check_bit(from) &&
+                !get_between_bb(king_sq, from).check_bit(to)) {
+                continue;
+            }
+            pos.set_captured_piece(m);
         }
-        Piece captured = m.get_captured_piece();
-        if (captured != NO_PIECE) {
-            // 敵の駒を捕る手なら、その手を前側に移動させる
-            std::swap(move_list[idx], move_list[i]);
-            idx++;
+        move_list[cnt++] = m;
+    }
+    move_list.cnt = cnt;
+}
+
+// 王手になる、駒を捕らない合法手と駒打ちをmove_listの末尾に追加する
+// 静止探索で使う
+void generate_quiet_checks(Position &pos, MoveList &move_list) {
+    const int begin = move_list.size();
+    generate_legal_moves(pos, move_list, GEN_QUIETS);
+    generate_legal_moves(pos, move_list, GEN_DROPS);
+    const int end = move_list.size();
+    int cnt = begin;
+    for (int i = begin; i < end; ++i) {
+        if (move_list[i].is_check(pos)) {
+            move_list[cnt++] = move_list[i];
+        }
+    }
+    move_list.cnt = cnt;
+}
+
+// 王手されていない局面で、mが合法手かどうかを判定する関数
+// 置換表の手やキラー手を、指し手を生成せずに確かめるために使う
+// 捕る駒も含めて、generate_legal_moves()が生成する手と一致するときだけtrueを返す
+bool is_legal_move(Position &pos, Move m) {
+    Color us = pos.side_to_move;
+    Square to = m.get_to();
+    // 置換表の手は別の局面のものかもしれないので、升の範囲から確かめる
+    if (m.is_none() || m.is_resign() || to >= SQ_NB ||
+        (!m.is_drop() && m.get_from() >= SQ_NB)) {
+        return false;
+    }
+    Piece captured = pos.piece_board[to];
+    if (m.is_drop()) {
+        Piece pr = m.get_dropped_piece();
+        if (captured != NO_PIECE || m.is_promote() ||
+            m.get_captured_piece() != NO_PIECE || pr == KING ||
+            pr < RAW_PIECE_BEGIN || pr >= RAW_PIECE_NB ||
+            !hand_exists(pos.hands[us], pr)) {
+            return false;
+        }
+        if (pr == PAWN) {
+            // 二歩と、成れる場所（＝敵陣）への歩打ち、打ち歩詰めは指せない
+            Bitboard pawns = pos.piece_bitboards[PAWN + us * PIECE_WHITE];
+            if ((pawns & FILE_BB[sq_to_file(to)]).p != 0 ||
+                PROMOTE_ZONE[us].check_bit(to) || is_pawn_drop_mate(to, pos)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Square from = m.get_from();
+    Piece pc = pos.piece_board[from];
+    if (pc == NO_PIECE || color_of(pc) != us ||
+        (captured != NO_PIECE && color_of(captured) == us) ||
+        m.get_captured_piece() != type_of(captured)) {
+        return false;
+    }
+    Piece pt = type_of(pc);
+    if (!(pos.*Piece_to_EffectFunc[pt])(from, us).check_bit(to)) {
+        return false;
+    }
+    // 成り・不成は生成する手と同じ規則（歩・角・飛車は成れるなら必ず成る）
+    bool can_promote = m.can_promote(us);
+    if (pt == PAWN || pt == BISHOP || pt == ROOK) {
+        if (m.is_promote() != can_promote) {
+            return false;
+        }
+    } else if (pt == SILVER) {
+        if (m.is_promote() && !can_promote) {
+            return false;
+        }
+    } else if (m.is_promote()) {
+        return false;
+    }
+    return is_safe_move(from, to, us, pos);
+}
+
+// color側の玉と敵の飛び駒の間にただ1つだけある、color側の駒（ピンされている駒）を返す
+Bitboard pinned_pieces(Color color, Position &pos) {
+    Square king_sq = pos.king_square(color);
+    const int w = ~color * PIECE_WHITE;
+    // 盤上に駒がないとしたときに、玉に利く位置にいる敵の飛び駒
+    Bitboard snipers = (bishop_effect_bb(king_sq, Bitboard(0)) &
+                        (pos.piece_bitboards[BISHOP + w] |
+                         pos.piece_bitboards[HORSE + w])) |
+                       (rook_effect_bb(king_sq, Bitboard(0)) &
+                        (pos.piece_bitboards[ROOK + w] |
+                         pos.piece_bitboards[DRAGON + w]));
+    Bitboard occupied = pos.occupied_bb(COLOR_ALL);
+    Bitboard ours = pos.occupied_bb(color);
+    Bitboard pinned = Bitboard(0);
+    while (snipers.p != 0) {
+        Bitboard b = get_between_bb(snipers.pop(), king_sq) & occupied;
+        // 間にある駒がちょうど1つで、それが自分の駒ならピンされている
+        if (b.p != 0 && (b.p & (b.p - 1)) == 0 && (b & ours).p != 0) {
+            pinned |= b;
+        }
+    }
+    return pinned;
+}
+
+// 手番側がtoに歩を打つと打ち歩詰めになるかどうかを判定する関数
+// 歩は玉の隣に打たれるので合駒はできず、王手を防ぐ手は次のどちらかしかない
+// ・玉がどこかに逃げる（打たれた歩を玉で捕る手も含む）
+// ・玉以外の駒で歩を捕る（ピンされている駒は捕れない）
+// 実際に歩を打って指し手を生成しなくても、この2つを調べれば判定できる
+bool is_pawn_drop_mate(Square to, Position &pos) {
+    Color us = pos.side_to_move;
+    Color them = ~us;
+    Bitboard enemy_king = pos.piece_bitboards[KING + them * PIECE_WHITE];
+    // 王手にならない歩打ちは打ち歩詰めではない
+    if ((PAWN_EFFECT_BB[to][us] & enemy_king).p == 0) {
+        return false;
+    }
+    Square king_sq = pos.king_square(them);
+    // 歩を打ったあとの駒の配置
+    Bitboard occupied = pos.occupied_bb(COLOR_ALL) | Bitboard(to);
+
+    // 玉以外の駒で歩を捕れるか
+    // 歩は玉の隣にあるので、ピンの線の上にある駒が歩を捕っても玉は取られない
+    Bitboard capturers = pos.attackers_to(them, to, occupied) & ~enemy_king;
+    if (capturers.p != 0) {
+        Bitboard pinned = pinned_pieces(them, pos);
+        while (capturers.p != 0) {
+            Square from = capturers.pop();
+            if (!pinned.check_bit(from) ||
+                get_between_bb(king_sq, to).check_bit(from) ||
+                get_between_bb(king_sq, from).check_bit(to)) {
+                return false;
+            }
+        }
+    }
+
+    // 玉が逃げられるか（歩を捕る手を含む）
+    // 玉が居なくなると、玉に利いていた飛び駒は玉の先にも利くので、玉を除いた配置で調べる
+    Bitboard escapes = KING_EFFECT_BB[king_sq] & ~pos.occupied_bb(them);
+    Bitboard without_king = occupied & ~enemy_king;
+    while (escapes.p != 0) {
+        Square sq = escapes.pop();
+        if (pos.attackers_to(us, sq, without_king).p == 0) {
+            return false;
         }
     }
+    return true;
 }
 
-std::vector<Move> generate_capture_mlist(const std::vector<Move> &move_list) {
-    std::vector<Move> capture_mlist;
+void sort_move_list(MoveList &move_list, Position &pos) {
+    // 敵の駒を捕る手を手前側に集め、MVV-LVA（価値の高い駒を価値の低い駒で捕る手ほど先）
+    // の順に並べる。捕らない手は生成した順のまま後ろに残す。
+    auto is_capture = [](Move m) {
+        return !m.is_drop() && m.get_captured_piece() != NO_PIECE;
+    };
+    auto mvv_lva = [&pos](Move m) {
+        return PIECE_VALUE[m.get_captured_piece()] * 64 -
+               PIECE_VALUE[type_of(pos.piece_board[m.get_from()])];
+    };
+    auto captures_end =
+        std::stable_partition(move_list.begin(), move_list.end(), is_capture);
+    std::stable_sort(move_list.begin(), captures_end,
+                     [&mvv_lva](Move a, Move b) {
+                         return mvv_lva(a) > mvv_lva(b);
+                     });
+}
+
+MoveList generate_capture_mlist(const MoveList &move_list) {
+    MoveList capture_mlist;
     for (auto m : move_list) {
         if (m.is_drop()) {
             continue;
@@ -125,23 +350,29 @@ std::vector<Move> generate_capture_mlist(const std::vector<Move> &move_list) {
 }
 
 // 駒打ち以外の指し手を生成する関数
-void generate_moves(Color color, std::vector<Move> &move_list, Position &pos) {
-    generate_piece_moves<PAWN>(color, move_list, pos);
-    generate_piece_moves<SILVER>(color, move_list, pos);
-    generate_piece_moves<GOLD>(color, move_list, pos);
-    generate_piece_moves<BISHOP>(color, move_list, pos);
-    generate_piece_moves<ROOK>(color, move_list, pos);
-    generate_piece_moves<PRO_PAWN>(color, move_list, pos);
-    generate_piece_moves<PRO_SILVER>(color, move_list, pos);
-    generate_piece_moves<HORSE>(color, move_list, pos);
-    generate_piece_moves<DRAGON>(color, move_list, pos);
-    generate_piece_moves<KING>(color, move_list, pos);
+void generate_moves(Color color, MoveList &move_list, Position &pos) {
+    generate_moves(color, move_list, Bitboard(0xFFFFFFFF), pos);
+}
+
+// targetに移動する、駒打ち以外の指し手を生成する関数
+void generate_moves(Color color, MoveList &move_list, Bitboard target,
+                    Position &pos) {
+    generate_piece_moves<PAWN>(color, move_list, target, pos);
+    generate_piece_moves<SILVER>(color, move_list, target, pos);
+    generate_piece_moves<GOLD>(color, move_list, target, pos);
+    generate_piece_moves<BISHOP>(color, move_list, target, pos);
+    generate_piece_moves<ROOK>(color, move_list, target, pos);
+    generate_piece_moves<PRO_PAWN>(color, move_list, target, pos);
+    generate_piece_moves<PRO_SILVER>(color, move_list, target, pos);
+    generate_piece_moves<HORSE>(color, move_list, target, pos);
+    generate_piece_moves<DRAGON>(color, move_list, target, pos);
+    generate_piece_moves<KING>(color, move_list, target, pos);
 }
 
 // targetへの駒打ちを生成する関数
 // 駒打ちの指し手を生成する関数
-void generate_drop_moves(Color color, Bitboard target,
-                         std::vector<Move> &move_list, Position &pos) {
+void generate_drop_moves(Color color, Bitboard target, MoveList &move_list,
+                         Position &pos) {
     // コマが無く、かつtargetに含まれる場所を探す
     Bitboard not_occupied = ~pos.occupied_bb(COLOR_NB) & target;
 
@@ -187,14 +418,12 @@ void generate_drop_moves(Color color, Bitboard target,
 }
 
 // 駒打ちの指し手（空いている場所全てが駒打ち候補）を生成する関数
-void generate_drop_moves(Color color, std::vector<Move> &move_list,
-                         Position &pos) {
+void generate_drop_moves(Color color, MoveList &move_list, Position &pos) {
     generate_drop_moves(color, Bitboard(0xFFFFFFFF), move_list, pos);
 }
 
 // 王手を防ぐために、玉以外の駒で王手を防ぐ指し手を生成し、move_listに追加する関数
-void generate_block_moves(Color color, std::vector<Move> &move_list,
-                          Position &pos) {
+void generate_block_moves(Color color, MoveList &move_list, Position &pos) {
     int checkers_cnt = 0; // 王手をしている駒の数
     const Color enemy_color = ~color;
     // 「王手をしている駒と玉の間のマス」に1を立てたBitboard
@@ -203,7 +432,11 @@ void generate_block_moves(Color color, std::vector<Move> &move_list,
     Square checker_sq;
 
     // 王手をしている敵駒の位置を取得
-    for (auto &[piece, effect_func] : Piece_to_EffectFunc) {
+    for (Piece piece = PIECE_BEGIN; piece < PIECE_NB; ++piece) {
+        EffectFunc effect_func = Piece_to_EffectFunc[piece];
+        if (effect_func == nullptr) {
+            continue;
+        }
         Bitboard bb = pos.piece_bitboards[piece + enemy_color * PIECE_WHITE];
         Square enemy_sq;
         while (bb.p != 0) {
@@ -244,7 +477,7 @@ void generate_block_moves(Color color, std::vector<Move> &move_list,
 }
 
 // 敵玉を捕れる指し手を生成する関数
-Move generate_king_capture_move(Color color, std::vector<Move> &move_list,
+Move generate_king_capture_move(Color color, MoveList &move_list,
                                 Position &pos) {
     Bitboard enemy_king = pos.piece_bitboards[KING + ~color * PIECE_WHITE];
 
@@ -264,8 +497,8 @@ Move generate_king_capture_move(Color color, std::vector<Move> &move_list,
 
 template <Piece piece>
 // ある種の駒（複数枚可）がtargetに移動するような指し手を生成する関数
-void generate_piece_moves(Color color, std::vector<Move> &mlist,
-                          const Bitboard target, Position &pos) {
+void generate_piece_moves(Color color, MoveList &mlist, const Bitboard target,
+                          Position &pos) {
     // ASSERT(piece == PAWN || piece == SILVER || piece == BISHOP ||
     //            piece == ROOK || piece == GOLD || piece == KING ||
     //            piece == PRO_PAWN || piece == PRO_SILVER || piece == HORSE ||
@@ -278,7 +511,9 @@ void generate_piece_moves(Color color, std::vector<Move> &mlist,
         Square from = pieces.pop();
 
         // 利き（移動先の候補）を計算
-        bb = (pos.*Piece_to_EffectFunc[piece])(from, color);
+        // pieceはテンプレート引数なので、呼び出す関数はコンパイル時に決まる
+        constexpr EffectFunc effect_func = Piece_to_EffectFunc[piece];
+        bb = (pos.*effect_func)(from, color);
         // 自軍の駒がある場所は移動先から除外する
         bb &= ~pos.occupied_bb(color);
         // targetに行けないような場所は移動先から除外する
@@ -322,32 +557,39 @@ void generate_piece_moves(Color color, std::vector<Move> &mlist,
         }
         // 玉
         else if constexpr (piece == KING) {
-            // 自玉を除く（敵の飛車角の利きに影響するので）
-            Square king_sq = pos.king_square(color);
-            Piece king = pos.clear_piece(king_sq);
-            // 自玉が居ない状態での敵の利きを再計算
-            // 例：左から飛車の王手がかかっているとき、玉が１マス右に逃げてしまうのを防止する
-            Bitboard enemy_effect_bb = pos.all_effect(~color);
             // 敵の駒の利きでない、かつ自分の利き、かつ自分の駒がない場所を取得
-            Bitboard safety_zone = ~enemy_effect_bb &
+            Bitboard safety_zone = ~pos.all_effect(~color) &
                                    pos.king_effect(from, color) &
-                                   ~pos.occupied_bb(color);
+                                   ~pos.occupied_bb(color) & target;
+            // 玉に利いている敵の飛び駒は、玉が居なければ玉の先にも利いている
+            // 例：左から飛車の王手がかかっているとき、玉が１マス右に逃げてしまうのを防止する
+            const int w = ~color * PIECE_WHITE;
+            Bitboard occupied = pos.occupied_bb(COLOR_ALL) & ~Bitboard(from);
+            Bitboard diagonal = bishop_effect_bb(from, occupied) &
+                                (pos.piece_bitboards[BISHOP + w] |
+                                 pos.piece_bitboards[HORSE + w]);
+            Bitboard straight = rook_effect_bb(from, occupied) &
+                                (pos.piece_bitboards[ROOK + w] |
+                                 pos.piece_bitboards[DRAGON + w]);
+            while (diagonal.p != 0) {
+                safety_zone &= ~bishop_effect_bb(diagonal.pop(), occupied);
+            }
+            while (straight.p != 0) {
+                safety_zone &= ~rook_effect_bb(straight.pop(), occupied);
+            }
             // その場所へ移動するような指し手を生成
             while (safety_zone.p != 0) {
                 Square to = safety_zone.pop();
                 Move m = Move(from, to);
                 mlist.push_back(m);
             }
-            // 取り除いた玉を戻す
-            pos.set_piece(king_sq, king);
         }
     }
 }
 
 // 特にtargetを指定しない場合の指し手生成関数
 template <Piece piece>
-void generate_piece_moves(Color color, std::vector<Move> &mlist,
-                          Position &pos) {
+void generate_piece_moves(Color color, MoveList &mlist, Position &pos) {
     Bitboard all = Bitboard(0xFFFFFFFF);
     generate_piece_moves<piece>(color, mlist, all, pos);
 }
@@ -358,42 +600,64 @@ bool is_safe_move(Move move, Color color, Position &pos) {
     // よって打ち歩詰めチェックのみ行っている
     if (move.is_drop()) {
         // 打ち歩詰めチェック
-        if (move.get_dropped_piece() == PAWN && move.is_check(pos)) {
-            pos.do_move(move);
-            std::vector<Move> mlist = generate_move_list(pos);
-            Move m = pos.select_random_move(mlist);
-            if (m.is_none()) {
-                pos.undo_move(move);
-                return false;
-            }
-            pos.undo_move(move);
-        }
-        return true;
+        return move.get_dropped_piece() != PAWN ||
+               !is_pawn_drop_mate(move.get_to(), pos);
     }
     return is_safe_move(move.get_from(), move.get_to(), color, pos);
 }
 
 // Sqにある駒を移動させたときに、color側が王手になるかどうかを判定する関数
+// 駒を実際には動かさず、動かしたあとの駒の配置で自玉に利く敵の駒があるかを調べる
 bool is_safe_move(Square from, Square to, Color color, Position &pos) {
-    // ASSERT(color_of(pos.piece_board[from]) == color, "move is not legal
-    // !!!"); 駒を実際に移動させる
-    Piece removed = pos.move_piece(from, to, false);
-    // 自玉の王手チェック
-    bool is_safe = !pos.is_check(color);
-    // 駒を戻す。unmove->set_pieceの順番に注意
-    pos.unmove_piece(from, to, false);
-    // 取り除いた敵の駒があれば戻す
-    if (removed) {
-        pos.set_piece(to, removed);
+    // ASSERT(color_of(pos.piece_board[from]) == color, "move is not legal !!!");
+    Bitboard occupied = pos.occupied_bb(COLOR_ALL) & ~Bitboard(from);
+    // 玉を動かす場合は、移動先に敵の駒が利いていなければよい
+    if (type_of(pos.piece_board[from]) == KING) {
+        return pos.attackers_to(~color, to, occupied).p == 0;
     }
-    return is_safe;
+    // それ以外は、動かした先で捕った駒（toにいた駒）を除いて、自玉に利く敵の駒がなければよい
+    occupied |= Bitboard(to);
+    Bitboard attackers =
+        pos.attackers_to(~color, pos.king_square(color), occupied);
+    return (attackers & ~Bitboard(to)).p == 0;
 }
 
 bool Move::is_check(Position &pos) const {
-    pos.do_move(*this);
-    bool is_check = pos.is_check(pos.side_to_move);
-    pos.undo_move(*this);
-    return is_check;
+    // 指し手を実行せずに、指した後の駒の配置で相手の玉への利きを調べる
+    Color us = pos.side_to_move;
+    if (pos.piece_bitboards[KING + (~us) * PIECE_WHITE].p == 0) {
+        return false;
+    }
+    Square king_sq = pos.king_square(~us);
+    Square to = get_to();
+    Bitboard occupied = pos.occupied_bb(COLOR_ALL) | Bitboard(to);
+    Piece moved;
+    if (is_drop()) {
+        moved = get_dropped_piece();
+    } else {
+        Square from = get_from();
+        occupied &= ~Bitboard(from);
+        moved = type_of(pos.piece_board[from]);
+        if (is_promote()) {
+            moved = to_promote(moved);
+        }
+        // 動いた駒の後ろにいた飛び駒による王手（開き王手）
+        const int w = us * PIECE_WHITE;
+        Bitboard diagonal =
+            (pos.piece_bitboards[BISHOP + w] | pos.piece_bitboards[HORSE + w]) &
+            ~Bitboard(from);
+        Bitboard straight =
+            (pos.piece_bitboards[ROOK + w] | pos.piece_bitboards[DRAGON + w]) &
+            ~Bitboard(from);
+        if (((bishop_effect_bb(king_sq, occupied) & diagonal) |
+             (rook_effect_bb(king_sq, occupied) & straight))
+                .p != 0) {
+            return true;
+        }
+    }
+    // 動いた駒（打った駒）による王手
+    Piece pc = static_cast<Piece>(moved + us * PIECE_WHITE);
+    return piece_effect(pc, to, occupied).check_bit(king_sq);
 }
 
 bool Move::is_danger(Position &pos, Bitboard &danger_zone) const {
@@ -404,17 +668,13 @@ bool Move::is_danger(Position &pos, Bitboard &danger_zone) const {
     Square from = get_from();
     // ASSERT(color_of(pos.piece_board[from]) == pos.side_to_move,
     //        "move is not legal !!!");
-    // 駒を実際に移動させる
-    Piece removed = pos.move_piece(from, to, false);
-    Bitboard enemy_effect = pos.all_effect(~pos.side_to_move);
-    Bitboard our_effect = pos.all_effect(pos.side_to_move);
-    Bitboard d = enemy_effect & ~our_effect;
-    bool is_danger = d.check_bit(to);
-    // 駒を戻す。unmove->set_pieceの順番に注意
-    pos.unmove_piece(from, to, false);
-    // 取り除いた敵の駒があれば戻す
-    if (removed) {
-        pos.set_piece(to, removed);
-    }
-    return is_danger;
-}
\ No newline at end of file
+    // 駒を実際には動かさず、動かしたあとの駒の配置でtoに利く駒を調べる
+    // toにいた駒は捕られるので、toに利く駒には含まれない
+    // fromの駒は動いたあとなので、味方の利きからは除く
+    Bitboard occupied = pos.occupied_bb(COLOR_ALL) & ~Bitboard(from);
+    occupied |= Bitboard(to);
+    Bitboard enemy_effect = pos.attackers_to(~pos.side_to_move, to, occupied);
+    Bitboard our_effect = pos.attackers_to(pos.side_to_move, to, occupied) &
+                          ~Bitboard(from);
+    return enemy_effect.p != 0 && our_effect.p == 0;
+}
@@ -3,6 +3,7 @@
 #include "bitboard.h"
 #include "position.h"
 #include "shogi.h"
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
 #include <string>
@@ -13,8 +14,6 @@ class Position;
 
 int sq_to_index(const std::string &sq);
 
-// 可変長配列のインスタンスを生成
-
 // 指し手
 // bit0..4:移動先のSquare
 // bit5..9:移動元のSquare or 駒打ちの場合は打つ駒種
@@ -32,7 +31,8 @@ struct Move {
         PROMOTE = 1 << 15      // 駒成りフラグ
     };
 
-    Move();
+    // 指し手リストの生成を速くするため、デフォルトコンストラクタでは初期化しない
+    Move() = default;
     Move(MoveType move_type);
     Move(const std::string &move);
     Move(Square from, Square to);
@@ -47,7 +47,7 @@ struct Move {
     // DROPやPROMOTEと違い、フラグを立てているわけではないのでビット演算はダメ
     bool is_resign() const { return value == RESIGN; }
     bool is_none() const { return value == NONE; }
-    // 
+    // 指した後に相手の玉に王手がかかるかどうか（指し手は合法であること）
     bool is_check(Position &pos) const;
     // 自分の駒の利きがなく、かつ相手の駒の利きがあるような場所（＝タダ）に移動する指し手かどうかを判定する
     bool is_danger(Position &pos, Bitboard &danger_zone) const;
@@ -125,36 +125,84 @@ inline std::ostream &operator<<(std::ostream &os, Move move) {
     return os;
 }
 
-std::vector<Move> generate_move_list(Position &pos);
-std::vector<Move> generate_move_list(Position &pos,
-                                     std::vector<Move> &move_list);
-std::vector<Move> generate_capture_mlist(const std::vector<Move> &move_list);
-void sort_move_list(std::vector<Move> &move_list, Position &pos);
-void generate_moves(Color color, std::vector<Move> &move_list, Position &pos);
-void generate_drop_moves(Color color, std::vector<Move> &move_list,
+// 1局面の指し手の最大数
+// 5x5将棋では盤上の駒の指し手と駒打ちを合わせても200手に届かないので、余裕を持たせている
+constexpr int MAX_MOVES = 256;
+
+// 指し手のリスト
+// std::vector<Move>と同じように使えるが、ヒープを確保せずスタック上に置かれる
+struct MoveList {
+    Move moves[MAX_MOVES];
+    int cnt = 0;
+
+    Move *begin() { return moves; }
+    Move *end() { return moves + cnt; }
+    const Move *begin() const { return moves; }
+    const Move *end() const { return moves + cnt; }
+    size_t size() const { return cnt; }
+    bool empty() const { return cnt == 0; }
+    void clear() { cnt = 0; }
+    void push_back(Move m) { moves[cnt++] = m; }
+    void pop_back() { --cnt; }
+    Move &back() { return moves[cnt - 1]; }
+    Move &operator[](size_t i) { return moves[i]; }
+    const Move &operator[](size_t i) const { return moves[i]; }
+    // 順番を保ったまま削除する
+    Move *erase(Move *it) {
+        std::copy(it + 1, end(), it);
+        --cnt;
+        return it;
+    }
+    // 末尾の指し手と入れ替えて削除する（順番は変わるが速い）
+    void swap_remove(size_t i) { moves[i] = moves[--cnt]; }
+};
+
+// 疑似合法手（自玉を取られる手や打ち歩詰めを含む）を生成する
+// 合法かどうかはis_safe_move()で調べる
+MoveList generate_move_list(Position &pos);
+void generate_move_list(Position &pos, MoveList &move_list);
+// generate_legal_moves()で生成する指し手の種類
+enum GenType {
+    GEN_CAPTURES, // 駒を捕る手（駒打ち以外）
+    GEN_QUIETS,   // 駒を捕らない手（駒打ち以外）
+    GEN_DROPS,    // 駒打ち
+    GEN_ALL,      // 全ての手
+};
+// 合法手だけを生成する（捕る駒もセットする）。is_safe_move()で調べなくてよい
+MoveList generate_legal_moves(Position &pos);
+void generate_legal_moves(Position &pos, MoveList &move_list);
+void generate_legal_moves(Position &pos, MoveList &move_list, GenType type);
+void generate_quiet_checks(Position &pos, MoveList &move_list);
+bool is_legal_move(Position &pos, Move m);
+Bitboard pinned_pieces(Color color, Position &pos);
+bool is_pawn_drop_mate(Square to, Position &pos);
+MoveList generate_capture_mlist(const MoveList &move_list);
+void sort_move_list(MoveList &move_list, Position &pos);
+void generate_moves(Color color, MoveList &move_list, Position &pos);
+void generate_moves(Color color, MoveList &move_list, Bitboard target,
+                    Position &pos);
+void generate_drop_moves(Color color, MoveList &move_list, Position &pos);
+void generate_drop_moves(Color color, Bitboard target, MoveList &move_list,
                          Position &pos);
-void generate_drop_moves(Color color, Bitboard target,
-                         std::vector<Move> &move_list, Position &pos);
-void generate_block_moves(Color color, std::vector<Move> &move_list,
-                          Position &pos);
-Move generate_king_capture_move(Color color, std::vector<Move> &move_list,
+void generate_block_moves(Color color, MoveList &move_list, Position &pos);
+Move generate_king_capture_move(Color color, MoveList &move_list,
                                 Position &pos);
 bool is_safe_move(Square from, Square to, Color color, Position &pos);
 bool is_safe_move(Move move, Color color, Position &pos);
 
 template <Piece piece>
-void generate_piece_moves(Color color, std::vector<Move> &mlist, Position &pos);
+void generate_piece_moves(Color color, MoveList &mlist, Position &pos);
 
 template <Piece piece>
-void generate_piece_moves(Color color, std::vector<Move> &mlist,
-                          Bitboard target, Position &pos);
+void generate_piece_moves(Color color, MoveList &mlist, Bitboard target,
+                          Position &pos);
 
 inline Move &operator|=(Move &m, Move value) {
     m.value |= value.value;
     return m;
 }
 
-inline std::ostream &operator<<(std::ostream &os, std::vector<Move> move_list) {
+inline std::ostream &operator<<(std::ostream &os, const MoveList &move_list) {
     for (auto m : move_list) {
         os << m << ' ';
     }
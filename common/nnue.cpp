@@ -0,0 +1,301 @@
+#include "nnue.h"
+#include "position.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// 定義すると、差分計算したアキュムレータを毎回全計算の結果と照合する（デバッグ用）
+// #define DEBUG_NNUE
+
+namespace NNUE {
+
+// 重みファイルの先頭に書かれている識別子
+static const char NNUE_FILE_MAGIC[4] = {'S', 'N', 'U', '1'};
+
+// 量子化の幅
+// アキュムレータと2層目の出力は、0~127が浮動小数点の0.0~1.0に対応する。
+// 2層目と出力層の重みは64倍して整数にしてある。
+const int ACTIVATION_MAX = 127;
+const int WEIGHT_SCALE_BITS = 6;
+const double OUTPUT_SCALE = ACTIVATION_MAX * (1 << WEIGHT_SCALE_BITS);
+
+// 重みファイルの形式（リトルエンディアン）
+//   char    magic[4]  "SNU1"
+//   uint32  FEATURE_NB, HALF_DIMS, HIDDEN_DIMS（このファイルの定数と一致すること）
+//   int16   1層目のバイアス[HALF_DIMS]
+//   int16   1層目の重み[FEATURE_NB][HALF_DIMS]
+//   int32   2層目のバイアス[HIDDEN_DIMS]
+//   int8    2層目の重み[HIDDEN_DIMS][2 * HALF_DIMS]
+//   int32   出力層のバイアス
+//   int8    出力層の重み[HIDDEN_DIMS]
+struct Network {
+    int16_t ft_bias[HALF_DIMS];
+    std::vector<int16_t> ft_weight; // [FEATURE_NB][HALF_DIMS]
+    int32_t l1_bias[HIDDEN_DIMS];
+    int8_t l1_weight[HIDDEN_DIMS][2 * HALF_DIMS];
+    int32_t out_bias;
+    int8_t out_weight[HIDDEN_DIMS];
+};
+
+static Network network;
+static bool loaded = false;
+
+// 駒の種類（先後の区別なし）から特徴量の番号への変換テーブル
+constexpr int PIECE_TYPE_INDEX[PIECE_NB] = {
+    -1, 0, 1, 2, 3, 4, 5, -1, -1, -1, -1, 6, 7, 8, 9,
+};
+// 持ち駒の種類から特徴量の番号への変換テーブル（玉は持ち駒にならない）
+constexpr int HAND_TYPE_INDEX[RAW_PIECE_NB] = {-1, 0, -1, 1, 2, 3, 4};
+
+// 視点側から見た升目（後手の視点では盤を180度回す）
+static inline int oriented(Square sq, Color perspective) {
+    return perspective == BLACK ? sq : SQ_NB - 1 - sq;
+}
+
+static inline int board_feature(Piece pc, Square sq, Color perspective) {
+    int side = color_of(pc) == perspective ? 0 : 1;
+    return (side * PIECE_TYPE_NB + PIECE_TYPE_INDEX[type_of(pc)]) * SQ_NB +
+           oriented(sq, perspective);
+}
+
+// ownerの持ち駒prの(k+1)枚目
+static inline int hand_feature(Color owner, Piece pr, int k,
+                               Color perspective) {
+    int side = owner == perspective ? 0 : 1;
+    return BOARD_FEATURE_NB +
+           (side * HAND_TYPE_NB + HAND_TYPE_INDEX[pr]) * HAND_MAX + k;
+}
+
+// 視点側の玉の位置の分のオフセット
+static inline int king_offset(Position &pos, Color perspective) {
+    return oriented(pos.king_square(perspective), perspective) *
+           FEATURES_PER_KING;
+}
+
+static inline void add_feature(int16_t *v, int feature) {
+    const int16_t *w = &network.ft_weight[(size_t)feature * HALF_DIMS];
+    for (int i = 0; i < HALF_DIMS; ++i) {
+        v[i] += w[i];
+    }
+}
+
+static inline void sub_feature(int16_t *v, int feature) {
+    const int16_t *w = &network.ft_weight[(size_t)feature * HALF_DIMS];
+    for (int i = 0; i < HALF_DIMS; ++i) {
+        v[i] -= w[i];
+    }
+}
+
+// 視点perspectiveのアキュムレータを、posの全ての駒から計算する
+static void refresh(Position &pos, Accumulator &acc, Color perspective) {
+    int16_t *v = acc.v[perspective];
+    std::copy(network.ft_bias, network.ft_bias + HALF_DIMS, v);
+    const int offset = king_offset(pos, perspective);
+    for (Square sq = SQ_ZERO; sq < SQ_NB; ++sq) {
+        Piece pc = pos.piece_board[sq];
+        if (pc != NO_PIECE) {
+            add_feature(v, offset + board_feature(pc, sq, perspective));
+        }
+    }
+    for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
+        for (Piece pr = RAW_PIECE_BEGIN; pr < RAW_PIECE_NB; ++pr) {
+            if (HAND_TYPE_INDEX[pr] < 0) {
+                continue;
+            }
+            int num = std::min(hand_count(pos.hands[c], pr), HAND_MAX);
+            for (int k = 0; k < num; ++k) {
+                add_feature(v, offset + hand_feature(c, pr, k, perspective));
+            }
+        }
+    }
+    acc.computed[perspective] = true;
+}
+
+// 1つ前の局面のアキュムレータprevに、accの変化を足し引きする
+static void update(const Accumulator &prev, Accumulator &acc, int offset,
+                   Color perspective) {
+    int16_t *v = acc.v[perspective];
+    std::copy(prev.v[perspective], prev.v[perspective] + HALF_DIMS, v);
+    const DirtyPiece &dp = acc.dirty;
+    for (int i = 0; i < dp.removed_cnt; ++i) {
+        sub_feature(v, offset + dp.removed[i][perspective]);
+    }
+    for (int i = 0; i < dp.added_cnt; ++i) {
+        add_feature(v, offset + dp.added[i][perspective]);
+    }
+    acc.computed[perspective] = true;
+}
+
+void AccumulatorStack::reset(Position &pos) {
+    top = 0;
+    for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
+        refresh(pos, stack[0], c);
+    }
+}
+
+void AccumulatorStack::push(Position &pos, const Move &move) {
+    ASSERT(top + 1 < STACK_SIZE, "NNUE accumulator stack overflow");
+    Accumulator &acc = stack[++top];
+    DirtyPiece &dp = acc.dirty;
+    acc.computed[BLACK] = acc.computed[WHITE] = false;
+    dp.removed_cnt = dp.added_cnt = 0;
+    dp.king_moved[BLACK] = dp.king_moved[WHITE] = false;
+
+    const Color us = pos.side_to_move;
+    auto remove_board = [&](Piece pc, Square sq) {
+        for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
+            dp.removed[dp.removed_cnt][c] = board_feature(pc, sq, c);
+        }
+        dp.removed_cnt++;
+    };
+    auto add_board = [&](Piece pc, Square sq) {
+        for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
+            dp.added[dp.added_cnt][c] = board_feature(pc, sq, c);
+        }
+        dp.added_cnt++;
+    };
+
+    if (move.is_drop()) {
+        // 持ち駒の最後の1枚が減って、盤上に駒が増える
+        Piece pr = move.get_dropped_piece();
+        int num = hand_count(pos.hands[us], pr);
+        for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
+            dp.removed[dp.removed_cnt][c] = hand_feature(us, pr, num - 1, c);
+        }
+        dp.removed_cnt++;
+        add_board((Piece)(pr + us * PIECE_WHITE), move.get_to());
+        return;
+    }
+
+    Square from = move.get_from();
+    Square to = move.get_to();
+    Piece moved = pos.piece_board[from];
+    Piece captured = pos.piece_board[to];
+    remove_board(moved, from);
+    add_board(move.is_promote() ? to_promote(moved) : moved, to);
+    if (type_of(moved) == KING) {
+        dp.king_moved[us] = true;
+    }
+    if (captured != NO_PIECE) {
+        remove_board(captured, to);
+        // 取った駒は持ち駒の(今の枚数+1)枚目になる
+        Piece pr = to_raw(captured);
+        int num = hand_count(pos.hands[us], pr);
+        if (HAND_TYPE_INDEX[pr] >= 0 && num < HAND_MAX) {
+            for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
+                dp.added[dp.added_cnt][c] = hand_feature(us, pr, num, c);
+            }
+            dp.added_cnt++;
+        }
+    }
+}
+
+const Accumulator &AccumulatorStack::current(Position &pos) {
+    for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
+        // 計算済みの局面か、c側の玉が動いた局面まで遡る
+        int j = top;
+        while (!stack[j].computed[c] && !stack[j].dirty.king_moved[c]) {
+            --j;
+        }
+        if (!stack[j].computed[c]) {
+            // 玉が動いた後は差分計算できないので、現在の局面を全計算する
+            refresh(pos, stack[top], c);
+        } else {
+            // 玉が動いていないので、途中の局面でも玉の位置は今と同じ
+            const int offset = king_offset(pos, c);
+            for (int k = j + 1; k <= top; ++k) {
+                update(stack[k - 1], stack[k], offset, c);
+            }
+        }
+    }
+#ifdef DEBUG_NNUE
+    Accumulator full;
+    for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
+        refresh(pos, full, c);
+        ASSERT(std::equal(full.v[c], full.v[c] + HALF_DIMS, stack[top].v[c]),
+               "NNUE accumulator is inconsistent !!!");
+    }
+#endif
+    return stack[top];
+}
+
+template <typename T> static bool read(std::ifstream &ifs, T *p, size_t n) {
+    ifs.read(reinterpret_cast<char *>(p), sizeof(T) * n);
+    return (bool)ifs;
+}
+
+bool load(const std::string &path) {
+    loaded = false;
+    std::ifstream ifs(path, std::ios::binary);
+    char magic[4];
+    uint32_t dims[3];
+    if (!read(ifs, magic, 4) ||
+        std::memcmp(magic, NNUE_FILE_MAGIC, 4) != 0 || !read(ifs, dims, 3) ||
+        dims[0] != FEATURE_NB || dims[1] != HALF_DIMS ||
+        dims[2] != HIDDEN_DIMS) {
+        return false;
+    }
+    network.ft_weight.resize((size_t)FEATURE_NB * HALF_DIMS);
+    if (!read(ifs, network.ft_bias, HALF_DIMS) ||
+        !read(ifs, network.ft_weight.data(), network.ft_weight.size()) ||
+        !read(ifs, network.l1_bias, HIDDEN_DIMS) ||
+        !read(ifs, &network.l1_weight[0][0], HIDDEN_DIMS * 2 * HALF_DIMS) ||
+        !read(ifs, &network.out_bias, 1) ||
+        !read(ifs, network.out_weight, HIDDEN_DIMS)) {
+        return false;
+    }
+    loaded = true;
+    return true;
+}
+
+bool is_loaded() { return loaded; }
+
+// アキュムレータから2層目と出力層を計算して、手番側から見た評価値を返す
+static double propagate(const Accumulator &acc, Color us) {
+    // 手番側の視点を前半、相手側の視点を後半に並べ、0~127に切り詰める
+    uint8_t x[2 * HALF_DIMS];
+    for (int i = 0; i < HALF_DIMS; ++i) {
+        x[i] = (uint8_t)std::clamp<int>(acc.v[us][i], 0, ACTIVATION_MAX);
+        x[HALF_DIMS + i] =
+            (uint8_t)std::clamp<int>(acc.v[~us][i], 0, ACTIVATION_MAX);
+    }
+    int32_t out = network.out_bias;
+    for (int o = 0; o < HIDDEN_DIMS; ++o) {
+        int32_t sum = network.l1_bias[o];
+        for (int i = 0; i < 2 * HALF_DIMS; ++i) {
+            sum += network.l1_weight[o][i] * x[i];
+        }
+        int32_t h = std::clamp(sum >> WEIGHT_SCALE_BITS, 0, ACTIVATION_MAX);
+        out += network.out_weight[o] * h;
+    }
+    // 出力は勝率のlogitなので、sigmoidで勝率に直す
+    return 1.0 / (1.0 + std::exp(-out / OUTPUT_SCALE));
+}
+
+double evaluate(Position &pos) {
+    ASSERT(loaded, "NNUE is not loaded");
+    if (pos.nnue != nullptr) {
+        return propagate(pos.nnue->current(pos), pos.side_to_move);
+    }
+    Accumulator acc;
+    for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
+        refresh(pos, acc, c);
+    }
+    return propagate(acc, pos.side_to_move);
+}
+
+void write_training_record(std::ostream &os, Position &pos, double target) {
+    for (Square sq = SQ_ZERO; sq < SQ_NB; ++sq) {
+        os << (int)pos.piece_board[sq] << " ";
+    }
+    for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
+        for (Piece pr = RAW_PIECE_BEGIN; pr < RAW_PIECE_NB; ++pr) {
+            os << hand_count(pos.hands[c], pr) << " ";
+        }
+    }
+    os << (int)pos.side_to_move << " " << target << "\n";
+}
+
+} // namespace NNUE
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "shogi.h"
+#include <iosfwd>
+#include <string>
+
+class Position;
+struct Move;
+
+// 差分計算できるニューラルネットワークの評価関数（NNUE）
+// 特徴量は「自玉の位置 x 盤上の駒の種類・位置」と「自玉の位置 x 持ち駒」で、
+// 先手から見たものと、後手から見たもの（盤を180度回したもの）の2組がある。
+// 1層目（特徴量 -> HALF_DIMS）の出力をアキュムレータとして持っておき、
+// 1手指すごとに変化した駒の分だけ足し引きして更新する。
+// 重みファイルはtraining/nnue.pyで学習・書き出したもの。
+namespace NNUE {
+
+// 盤上の駒の特徴量：駒の種類（玉を含む10種類）x 自分 / 相手 x 升目
+const int PIECE_TYPE_NB = 10;
+const int BOARD_FEATURE_NB = PIECE_TYPE_NB * 2 * SQ_NB;
+// 持ち駒の特徴量：駒の種類（5種類）x 自分 / 相手 x 何枚目か
+const int HAND_TYPE_NB = 5;
+const int HAND_MAX = 2;
+const int HAND_FEATURE_NB = HAND_TYPE_NB * 2 * HAND_MAX;
+// 自玉の位置1つあたりの特徴量の数と、全体の特徴量の数
+const int FEATURES_PER_KING = BOARD_FEATURE_NB + HAND_FEATURE_NB;
+const int FEATURE_NB = SQ_NB * FEATURES_PER_KING;
+
+// アキュムレータの大きさ（片方の視点あたり）と、2層目の出力の大きさ
+const int HALF_DIMS = 64;
+const int HIDDEN_DIMS = 32;
+
+// 1手で取り除かれる / 加わる特徴量の最大数
+// （移動元の駒と取られた駒 / 移動先の駒と増えた持ち駒）
+const int MAX_CHANGED = 2;
+// アキュムレータのスタックの深さ（探索の手数に、合法手の判定で指す分を足したもの）
+const int STACK_SIZE = 256;
+
+// 1手で変化した特徴量（自玉の位置の分を除いたもの。視点ごとに持つ）
+struct DirtyPiece {
+    int removed_cnt = 0;
+    int added_cnt = 0;
+    int removed[MAX_CHANGED][COLOR_NB];
+    int added[MAX_CHANGED][COLOR_NB];
+    // 玉が動いた側の視点は全ての特徴量が変わるので、差分ではなく全計算する
+    bool king_moved[COLOR_NB] = {false, false};
+};
+
+struct Accumulator {
+    alignas(32) int16_t v[COLOR_NB][HALF_DIMS];
+    bool computed[COLOR_NB] = {false, false};
+    DirtyPiece dirty; // 1つ前の局面からの変化
+};
+
+// 探索中の局面のアキュムレータを手数の分だけ積んでおくスタック
+// Position::nnueに設定すると、do_moveで変化を積み、undo_moveで降ろす。
+// 実際の足し引きはevaluate()が呼ばれるまで行わない（評価しない局面の分は省ける）。
+class AccumulatorStack {
+  public:
+    // posの局面をスタックの底にして全計算する
+    void reset(Position &pos);
+    // pos（指す前の局面）でmoveを指したときの変化を積む
+    void push(Position &pos, const Move &move);
+    void pop() { --top; }
+    // 現在の局面posのアキュムレータを、計算済みの局面から差分計算して返す
+    const Accumulator &current(Position &pos);
+
+  private:
+    Accumulator stack[STACK_SIZE];
+    int top = 0;
+};
+
+// 重みファイルを読み込む。失敗した場合はfalseを返し、読み込み済みの重みも捨てる。
+bool load(const std::string &path);
+bool is_loaded();
+// 手番側から見た評価値（勝率、0.0 ~ 1.0）
+// pos.nnueが設定されていれば差分計算し、なければ全計算する
+double evaluate(Position &pos);
+
+// 学習データを1局面1行で書き出す
+// 盤上の駒25個、先後の持ち駒6種類ずつ、手番、教師の値（手番側の勝率）の順で、
+// training/のプレイアウトのデータ（JSONの"X"）と同じ並びにしてある。
+void write_training_record(std::ostream &os, Position &pos, double target);
+
+} // namespace NNUE
@@ -0,0 +1,128 @@
+#include "perft.h"
+#include "string_ex.h"
+#include <chrono>
+#include <iostream>
+
+uint64_t perft(Position &pos, int depth) {
+    if (depth <= 0) {
+        return 1;
+    }
+    MoveList move_list = generate_legal_moves(pos);
+    // 1手先は合法手の数がそのまま局面数になる
+    if (depth == 1) {
+        return move_list.size();
+    }
+    uint64_t nodes = 0;
+    for (auto m : move_list) {
+        pos.do_move(m);
+        nodes += perft(pos, depth - 1);
+        pos.undo_move(m);
+    }
+    return nodes;
+}
+
+uint64_t divide(Position &pos, int depth) {
+    MoveList move_list = generate_legal_moves(pos);
+    uint64_t total = 0;
+    for (auto m : move_list) {
+        uint64_t nodes = 1;
+        if (depth > 1) {
+            pos.do_move(m);
+            nodes = perft(pos, depth - 1);
+            pos.undo_move(m);
+        }
+        std::cout << m << ": " << nodes << std::endl;
+        total += nodes;
+    }
+    std::cout << "total: " << total << std::endl;
+    return total;
+}
+
+Position position_from_moves(const std::string &moves) {
+    Position pos = Position();
+    StringEx str = moves;
+    for (auto &s : str.Split()) {
+        if (s.empty()) {
+            continue;
+        }
+        Move m = Move(s);
+        pos.set_captured_piece(m);
+        pos.do_move(m);
+    }
+    return pos;
+}
+
+bool bench(int depth) {
+    if (depth < 1) {
+        std::cout << "invalid depth: " << depth << std::endl;
+        return false;
+    }
+    bool passed = true;
+    uint64_t total_nodes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < PERFT_SUITE.size(); ++i) {
+        const PerftPosition &pp = PERFT_SUITE[i];
+        Position pos = position_from_moves(pp.moves);
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t nodes = perft(pos, depth);
+        auto t1 = std::chrono::steady_clock::now();
+        double sec = std::chrono::duration<double>(t1 - t0).count();
+        total_nodes += nodes;
+
+        std::cout << "position " << i + 1 << " depth " << depth
+                  << " nodes " << nodes << " nps "
+                  << (uint64_t)(sec > 0 ? nodes / sec : 0);
+        // 期待値があれば照合する
+        if (depth <= (int)pp.expected.size()) {
+            uint64_t expected = pp.expected[depth - 1];
+            if (nodes != expected) {
+                std::cout << " MISMATCH (expected " << expected << ")";
+                passed = false;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    double sec = std::chrono::duration<double>(end - start).count();
+    std::cout << "===========================" << std::endl;
+    std::cout << "total nodes: " << total_nodes << std::endl;
+    std::cout << "time(ms): " << (uint64_t)(sec * 1000) << std::endl;
+    std::cout << "nodes/sec: " << (uint64_t)(sec > 0 ? total_nodes / sec : 0)
+              << std::endl;
+    std::cout << "result: " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+// 指し手生成は「歩・角・飛は成れるなら必ず成る」ので、
+// 一般的なミニ将棋のperftの値とは3手目以降で一致しない
+const std::vector<PerftPosition> PERFT_SUITE = {
+    // 初期局面
+    {"", {14, 181, 2484, 34663, 510149}},
+    // 序盤：飛車の打ち込み
+    {"1e1b 2a1b 4e4d 3a2b 4d4c 5a5d 5e5d R*4b 4c4b P*5c 5d5c 4a1d",
+     {47, 464, 20930, 244496}},
+    // 中盤：互いに持ち駒が多い
+    {"1e1b 2a1b 3e4d R*3b P*2c 1b2c 2e1d 3b4b 5d5c 2c3d 5e5d 5a5c 5d5c "
+     "3d4d 1d4a+ 4b4a",
+     {44, 2434, 65221, 2960151}},
+    // 王手がかかっている局面
+    {"1e1b 1a1b 3e2d 5a5d 5e5d 3a2b R*5c P*1a P*1d 4a1d 2d2c 1b1c 5c5b "
+     "P*3b 2e1d R*5a 2c2b 1c1d 5d5c 5a5b",
+     {3, 141, 5996, 186643}},
+    // 成駒がある局面
+    {"1e1b 2a1b 2e5b R*2a 5b4a+ 5a4a P*3c 4a4e+ 5e4e G*2b 3e3d B*2e 3d2e "
+     "2b3c 2e2d 3c2d B*2c S*1d R*3b 1d2c 3b3a+ 2a3a",
+     {39, 2273, 44548, 2092840}},
+    // 終盤：金を2枚持っている
+    {"1e1b 2a1b P*2c 5a5d 4e5d 1b2c R*5b 4a5b 2e5b 2c3d 3e3d R*1b G*4b "
+     "R*2c 3d2c 1b4b 5d5c P*2b 2c2b 1a2b 5c4b 3a4b P*1e S*3a R*3b 2b3b "
+     "R*4e R*1c",
+     {29, 942, 17264, 522991}},
+    // 終盤：玉が露出している
+    {"1e1b 2a1b 4e3d 4a5b P*3b R*4c 3e4d 1a2b 3b3a+ 5a3a 4d4c 1b1c S*3c "
+     "3a3c 3d3c 2b1b 4c5b S*3e R*4b P*3b 3c3b 1c1d 3b2a 1b1c 2e1d 1c1d "
+     "4b2b B*3d R*4d 3e2d+",
+     {61, 682, 32117, 291740}},
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "position.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 指し手生成の正しさと速度を確かめるためのperft
+// 千日手は考慮せず、合法手だけを数え上げる
+
+// depth手先までの局面数を返す（depth=0なら1）
+uint64_t perft(Position &pos, int depth);
+// perftを初手ごとに分けて出力する
+uint64_t divide(Position &pos, int depth);
+
+// 初期局面から指し手を進めてベンチマーク用の局面を作る
+// movesはUSI形式の指し手をスペース区切りで並べたもの
+Position position_from_moves(const std::string &moves);
+
+// ベンチマーク用の局面と、perftの期待値
+struct PerftPosition {
+    std::string moves;               // 初期局面からの指し手
+    std::vector<uint64_t> expected; // expected[d-1]がdepth=dでの局面数
+};
+extern const std::vector<PerftPosition> PERFT_SUITE;
+
+// benchコマンドでdepthを省略したときの深さ
+const int BENCH_DEPTH = 4;
+
+// PERFT_SUITEの全局面でperftを実行し、局面数の照合とnodes/secの計測を行う
+// 全て期待値と一致すればtrueを返す（depthは1以上）
+bool bench(int depth);
@@ -1,12 +1,19 @@
 #include "position.h"
+#include "nnue.h"
 #include <algorithm> // ソートを使えるようにする
 #include <bitset>
+#include <cstring>
 #include <ctime>
 #include <random>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
-std::vector<HASH_KEY> visited_hash_keys;
+// 乱数の種。同時に動くスレッド同士で同じ乱数列にならないよう、スレッドIDも混ぜる
+static unsigned int random_seed() {
+    size_t id = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return static_cast<unsigned int>(std::time(nullptr) ^ id);
+}
 
 // 初期盤面を生成するコンストラクタ
 Position::Position() {
@@ -55,6 +62,11 @@ Position::Position() {
     // 手札の初期化
     hands[BLACK] = Hand(0);
     hands[WHITE] = Hand(0);
+
+    // ハッシュ値と駒の価値の初期化（以降は差分更新する）
+    hash_key = compute_hash_key();
+    compute_materials();
+    compute_effects();
 }
 
 // Positionをコピーするコンストラクタ
@@ -68,9 +80,46 @@ Position::Position(const Position &pos) {
     side_to_move = pos.side_to_move;
     // 手札のコピー
     std::copy(std::begin(pos.hands), std::end(pos.hands), std::begin(hands));
+    // ハッシュ値と駒の価値のコピー
+    hash_key = pos.hash_key;
+    std::copy(std::begin(pos.materials), std::end(pos.materials),
+              std::begin(materials));
+    // 利きのコピー
+    std::copy(std::begin(pos.effects), std::end(pos.effects),
+              std::begin(effects));
+    std::memcpy(effect_cnt, pos.effect_cnt, sizeof(effect_cnt));
+}
+
+// 代入もコピーと同じく、NNUEのアキュムレータは引き継がない
+Position &Position::operator=(const Position &pos) {
+    if (this != &pos) {
+        std::copy(std::begin(pos.piece_board), std::end(pos.piece_board),
+                  std::begin(piece_board));
+        std::copy(std::begin(pos.piece_bitboards),
+                  std::end(pos.piece_bitboards), std::begin(piece_bitboards));
+        side_to_move = pos.side_to_move;
+        std::copy(std::begin(pos.hands), std::end(pos.hands),
+                  std::begin(hands));
+        hash_key = pos.hash_key;
+        std::copy(std::begin(pos.materials), std::end(pos.materials),
+                  std::begin(materials));
+        std::copy(std::begin(pos.effects), std::end(pos.effects),
+                  std::begin(effects));
+        std::memcpy(effect_cnt, pos.effect_cnt, sizeof(effect_cnt));
+        nnue = nullptr;
+    }
+    return *this;
 }
 
 HASH_KEY Position::get_hash_key() {
+#ifdef DEBUG_HASH_KEY
+    ASSERT(hash_key == compute_hash_key(), "hash_key is inconsistent !!!");
+#endif
+    return hash_key;
+}
+
+// 盤面と手駒からハッシュ値を計算し直す
+HASH_KEY Position::compute_hash_key() {
     HASH_KEY hash_key = 0;
     // 盤上の駒のハッシュ値を計算
     for (Square sq = SQ_ZERO; sq < SQ_NB; ++sq) {
@@ -94,6 +143,47 @@ HASH_KEY Position::get_hash_key() {
     return hash_key;
 }
 
+// 盤面と手駒から駒の価値の合計を計算し直す
+void Position::compute_materials() {
+    materials[BLACK] = materials[WHITE] = 0;
+    for (Square sq = SQ_ZERO; sq < SQ_NB; ++sq) {
+        Piece pc = piece_board[sq];
+        if (pc != NO_PIECE) {
+            materials[color_of(pc)] += PIECE_VALUE[type_of(pc)];
+        }
+    }
+    for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
+        for (Piece pr = RAW_PIECE_BEGIN; pr < RAW_PIECE_NB; ++pr) {
+            materials[c] += hand_count(hands[c], pr) * PIECE_VALUE[pr];
+        }
+    }
+}
+
+// 盤面から利きを計算し直す
+void Position::compute_effects() {
+    effects[BLACK] = effects[WHITE] = Bitboard(0);
+    std::memset(effect_cnt, 0, sizeof(effect_cnt));
+    for (Square sq = SQ_ZERO; sq < SQ_NB; ++sq) {
+        Piece pc = piece_board[sq];
+        if (pc != NO_PIECE) {
+            Color c = color_of(pc);
+            add_effect(c, (this->*Piece_to_EffectFunc[type_of(pc)])(sq, c));
+        }
+    }
+}
+
+#ifdef DEBUG_EFFECT
+// 差分更新した利きが、全計算した結果と一致するかどうか
+static bool is_effects_consistent(const Position &pos) {
+    Position p = pos;
+    p.compute_effects();
+    return std::memcmp(p.effect_cnt, pos.effect_cnt, sizeof(p.effect_cnt)) ==
+               0 &&
+           p.effects[BLACK].p == pos.effects[BLACK].p &&
+           p.effects[WHITE].p == pos.effects[WHITE].p;
+}
+#endif
+
 void Position::do_move(const Move &move) {
     if (move.is_resign()) {
         std::cout << "Position::do_move resign" << std::endl;
@@ -103,10 +193,15 @@ void Position::do_move(const Move &move) {
         std::cout << "Position::do_move none" << std::endl;
         return;
     }
+    if (nnue) {
+        nnue->push(*this, move);
+    }
     // 駒打ちの場合
     if (move.is_drop()) {
         Piece pr = move.get_dropped_piece(); // 駒種を取得
         sub_hand(hands[side_to_move], pr);   // 持ち駒を減らす
+        hash_key -= Zobrist::hand[side_to_move][pr];
+        materials[side_to_move] -= PIECE_VALUE[pr];
         Square to = move.get_to();           // bit4..0を取得
         // そこに駒を打つ
         Piece dropped = (Piece)(pr + side_to_move * PIECE_WHITE);
@@ -119,18 +214,33 @@ void Position::do_move(const Move &move) {
         // 捕られた駒があれば、手番側の持ち駒に加える
         if (captured) {
             add_hand(hands[side_to_move], to_raw(captured));
+            hash_key += Zobrist::hand[side_to_move][to_raw(captured)];
+            materials[side_to_move] += PIECE_VALUE[to_raw(captured)];
         }
     }
 
     side_to_move = ~side_to_move;
+    // ハッシュ値の0ビット目は手番を表す
+    hash_key ^= 1;
+#ifdef DEBUG_HASH_KEY
+    ASSERT(hash_key == compute_hash_key(), "hash_key is inconsistent !!!");
+#endif
+#ifdef DEBUG_EFFECT
+    ASSERT(is_effects_consistent(*this), "effects are inconsistent !!!");
+#endif
 }
 
 void Position::undo_move(const Move &move) {
+    if (nnue) {
+        nnue->pop();
+    }
     // 駒打ちの場合
     if (move.is_drop()) {
         // 打たれた駒を、打ち手の持ち駒に戻す
         Piece pr = move.get_dropped_piece();
         add_hand(hands[~side_to_move], pr);
+        hash_key += Zobrist::hand[~side_to_move][pr];
+        materials[~side_to_move] += PIECE_VALUE[pr];
         // 打たれた駒のBitboardをクリア
         Square to = move.get_to();
         clear_piece(to);
@@ -140,22 +250,36 @@ void Position::undo_move(const Move &move) {
     else {
         Square from = move.get_from();
         Square to = move.get_to();
-        // 移動した駒を、成りを考慮して元に戻す
-        unmove_piece(from, to, move.is_promote());
         // 取られた駒のチェック
         Piece pn = move.get_captured_piece();
+        Piece pc = NO_PIECE;
         // 取られた駒があれば、前のプレイヤーの持ち駒から手放して手番側の盤面に置く
         if (pn) {
             // 生駒に戻してから手札から引く
             Piece pr = to_raw(pn);
             sub_hand(hands[~side_to_move], pr);
-            Piece pc = (Piece)(pn | side_to_move * PIECE_WHITE);
-            set_piece(to, pc);
+            hash_key -= Zobrist::hand[~side_to_move][pr];
+            materials[~side_to_move] -= PIECE_VALUE[pr];
+            pc = (Piece)(pn | side_to_move * PIECE_WHITE);
         }
+        // 移動した駒を、成りを考慮して元に戻す（取られた駒はtoに戻す）
+        unmove_piece(from, to, move.is_promote(), pc);
     }
 
     // 手番を反転させる
     side_to_move = ~side_to_move;
+    hash_key ^= 1;
+#ifdef DEBUG_HASH_KEY
+    ASSERT(hash_key == compute_hash_key(), "hash_key is inconsistent !!!");
+#endif
+#ifdef DEBUG_EFFECT
+    ASSERT(is_effects_consistent(*this), "effects are inconsistent !!!");
+#endif
+}
+
+void Position::do_null_move() {
+    side_to_move = ~side_to_move;
+    hash_key ^= 1;
 }
 
 // fromからtoへ駒を移動させる関数。捕られた駒を返す。
@@ -167,13 +291,42 @@ Piece Position::move_piece(Square from, Square to, bool is_promote) {
     if (is_promote) {
         moved = moved | PIECE_PROMOTE;
     }
-    Piece captured = clear_piece(to);
-    if (captured) {
+    // 駒を捕る場合はtoの駒を入れ替える（toの駒の有無は変わらない）
+    if (piece_board[to] != NO_PIECE) {
         // 動いた駒と捕られた駒は別陣営のはず
-        // ASSERT(color_of(moved) != color_of(captured), "capture own piece");
+        // ASSERT(color_of(moved) != color_of(piece_board[to]), "");
+        return replace_piece(to, moved);
     }
     set_piece(to, moved);
-    return captured;
+    return NO_PIECE;
+}
+
+// sqにある駒pc（先後の区別あり）の利き。occupiedは盤上の駒の配置
+// set_piece / clear_pieceで、駒の配置を計算し直さずに利きを求めるために使う
+Bitboard piece_effect(Piece pc, Square sq, Bitboard occupied) {
+    Color c = color_of(pc);
+    switch (type_of(pc)) {
+    case PAWN:
+        return PAWN_EFFECT_BB[sq][c];
+    case SILVER:
+        return SILVER_EFFECT_BB[sq][c];
+    case GOLD:
+    case PRO_PAWN:
+    case PRO_SILVER:
+        return GOLD_EFFECT_BB[sq][c];
+    case KING:
+        return KING_EFFECT_BB[sq];
+    case BISHOP:
+        return bishop_effect_bb(sq, occupied);
+    case ROOK:
+        return rook_effect_bb(sq, occupied);
+    case HORSE:
+        return bishop_effect_bb(sq, occupied) | CROSS_EFFECT_BB[sq];
+    case DRAGON:
+        return rook_effect_bb(sq, occupied) | X_EFFECT_BB[sq];
+    default:
+        return Bitboard(0);
+    }
 }
 
 // sqにある駒を取り除く関数。取り除かれた駒（先後の区別あり）を返す。
@@ -181,8 +334,15 @@ Piece Position::clear_piece(Square sq) {
     Piece removed = piece_board[sq];
     if (removed == NO_PIECE)
         return NO_PIECE;
+    Bitboard occupied = occupied_bb(COLOR_ALL);
+    Color c = color_of(removed);
+    sub_effect(c, piece_effect(removed, sq, occupied));
     piece_board[sq] = NO_PIECE;
     piece_bitboards[removed].clear_bit(sq);
+    hash_key -= Zobrist::psq[removed][sq];
+    materials[c] -= PIECE_VALUE[type_of(removed)];
+    // sqで止まっていた飛び駒の利きが先に伸びる
+    update_slider_effects(sq, occupied, occupied & ~Bitboard(sq));
     return removed;
 }
 
@@ -193,13 +353,88 @@ void Position::set_piece(Square sq, Piece pc) {
     if (pc == NO_PIECE) {
         return;
     }
+    Bitboard occupied = occupied_bb(COLOR_ALL);
+    Color c = color_of(pc);
+    piece_board[sq] = pc;
+    piece_bitboards[pc].set_bit(sq);
+    hash_key += Zobrist::psq[pc][sq];
+    materials[c] += PIECE_VALUE[type_of(pc)];
+    // sqを通っていた飛び駒の利きがsqで止まる
+    update_slider_effects(sq, occupied, occupied | Bitboard(sq));
+    add_effect(c, piece_effect(pc, sq, occupied));
+}
+
+// sqにある駒を駒pcに入れ替える関数。元の駒（先後の区別あり）を返す。
+// sqの駒の有無は変わらないので、飛び駒の利きは更新しなくてよい
+Piece Position::replace_piece(Square sq, Piece pc) {
+    Piece removed = piece_board[sq];
+    Bitboard occupied = occupied_bb(COLOR_ALL);
+    sub_effect(color_of(removed), piece_effect(removed, sq, occupied));
+    piece_bitboards[removed].clear_bit(sq);
+    hash_key -= Zobrist::psq[removed][sq];
+    materials[color_of(removed)] -= PIECE_VALUE[type_of(removed)];
     piece_board[sq] = pc;
     piece_bitboards[pc].set_bit(sq);
+    hash_key += Zobrist::psq[pc][sq];
+    materials[color_of(pc)] += PIECE_VALUE[type_of(pc)];
+    add_effect(color_of(pc), piece_effect(pc, sq, occupied));
+    return removed;
+}
+
+// bbの升に、color側の駒の利きを1つずつ足す
+void Position::add_effect(Color color, Bitboard bb) {
+    while (bb.p != 0) {
+        Square sq = bb.pop();
+        if (effect_cnt[color][sq]++ == 0) {
+            effects[color].set_bit(sq);
+        }
+    }
+}
+
+// bbの升から、color側の駒の利きを1つずつ引く
+void Position::sub_effect(Color color, Bitboard bb) {
+    while (bb.p != 0) {
+        Square sq = bb.pop();
+        if (--effect_cnt[color][sq] == 0) {
+            effects[color].clear_bit(sq);
+        }
+    }
+}
+
+// sqの駒の有無が変わったときに、sqに利いている飛び駒（角・飛・馬・龍）の利きを更新する
+// sqより先の利きだけが変わるので、その飛び駒の角・飛の方向の利きを引き直す
+void Position::update_slider_effects(Square sq, Bitboard old_occupied,
+                                     Bitboard new_occupied) {
+    Bitboard diagonal = piece_bitboards[B_BISHOP] | piece_bitboards[B_HORSE] |
+                        piece_bitboards[W_BISHOP] | piece_bitboards[W_HORSE];
+    Bitboard straight = piece_bitboards[B_ROOK] | piece_bitboards[B_DRAGON] |
+                        piece_bitboards[W_ROOK] | piece_bitboards[W_DRAGON];
+    // sqから見た角・飛の利きの先にいる駒が、sqに利いている飛び駒
+    // （sqまでの利きは、sqに駒があってもなくても変わらない）
+    Bitboard sliders = (bishop_effect_bb(sq, old_occupied) & diagonal) |
+                       (rook_effect_bb(sq, old_occupied) & straight);
+    while (sliders.p != 0) {
+        Square from = sliders.pop();
+        Color c = color_of(piece_board[from]);
+        Bitboard old_bb, new_bb;
+        if (diagonal.check_bit(from)) {
+            old_bb = bishop_effect_bb(from, old_occupied);
+            new_bb = bishop_effect_bb(from, new_occupied);
+        } else {
+            old_bb = rook_effect_bb(from, old_occupied);
+            new_bb = rook_effect_bb(from, new_occupied);
+        }
+        sub_effect(c, old_bb & ~new_bb);
+        add_effect(c, new_bb & ~old_bb);
+    }
 }
 
 // toからfromへ、駒を戻す関数。引数の順番に注意。unpromoteは成りを解除するかどうか。
-void Position::unmove_piece(Square from, Square to, bool unpromote) {
-    Piece moved_piece = clear_piece(to);
+// capturedを渡すと、捕られていたその駒をtoに戻す
+void Position::unmove_piece(Square from, Square to, bool unpromote,
+                            Piece captured) {
+    Piece moved_piece =
+        captured ? replace_piece(to, captured) : clear_piece(to);
     // toに駒があることを保証する
     // ASSERT(moved_piece != NO_PIECE, "to is empty");
     // 成りの指し手であれば成りを解除する
@@ -214,6 +449,24 @@ bool Position::is_check(Color color) {
     return all_effect(~color) && piece_bitboards[KING + color * PIECE_WHITE];
 }
 
+// 盤上の駒の配置がoccupiedのときに、sqに利いているcolor側の駒の位置を返す
+// 歩・銀・金の利きは先後で向きが逆なので、sqから相手側の向きの利きを引けばよい
+Bitboard Position::attackers_to(Color color, Square sq, Bitboard occupied) {
+    const int w = color * PIECE_WHITE;
+    Bitboard golds = piece_bitboards[GOLD + w] | piece_bitboards[PRO_PAWN + w] |
+                     piece_bitboards[PRO_SILVER + w];
+    Bitboard diagonal = piece_bitboards[BISHOP + w] | piece_bitboards[HORSE + w];
+    Bitboard straight = piece_bitboards[ROOK + w] | piece_bitboards[DRAGON + w];
+    return (PAWN_EFFECT_BB[sq][~color] & piece_bitboards[PAWN + w]) |
+           (SILVER_EFFECT_BB[sq][~color] & piece_bitboards[SILVER + w]) |
+           (GOLD_EFFECT_BB[sq][~color] & golds) |
+           (KING_EFFECT_BB[sq] & piece_bitboards[KING + w]) |
+           (CROSS_EFFECT_BB[sq] & piece_bitboards[HORSE + w]) |
+           (X_EFFECT_BB[sq] & piece_bitboards[DRAGON + w]) |
+           (bishop_effect_bb(sq, occupied) & diagonal) |
+           (rook_effect_bb(sq, occupied) & straight);
+}
+
 // piece_bitboardsの論理和を返す
 Bitboard Position::occupied_bb(Color color) {
     if (color == BLACK) {
@@ -267,113 +520,11 @@ Bitboard Position::king_effect(Square sq, Color color) {
 }
 
 Bitboard Position::bishop_effect(Square sq, Color color) {
-    Bitboard occ = occupied_bb(COLOR_ALL);
-    // 角の斜め方向にあるコマしか利きに影響を与えないので、それ以外の駒を無視する
-    occ &= BISHOP_EFFECT_BB[sq][DIRECTION_X];
-
-    // ハッシュ表を漁る
-    HASH_KEY key = Bitboards::h(sq, occ);
-    auto it = Bitboards::hash_bishop_effect.find(key);
-
-    // キーが見つかった場合
-    if (it != Bitboards::hash_bishop_effect.end()) {
-        Bitboard result = it->second;
-        return result;
-
-    } else {
-        // キーが見つからなかった場合は地道に計算する
-        Bitboard result = Bitboard(0);
-        // 右上方向
-        Bitboard mask = BISHOP_EFFECT_BB[sq][DIRECTION_UPPER_RIGHT];
-        Bitboard upper_right = mask & occ;             // マスク
-        upper_right = reverse_bitboard(upper_right.p); // 逆転
-        Bitboard minus_one = upper_right.p - 1;        // 1を引く
-        upper_right ^= minus_one; // 1を引いたものとXOR
-        upper_right = reverse_bitboard(upper_right.p); // 逆転
-        upper_right &= mask; // 再度マスクをかける
-
-        // 右下方向
-        mask = BISHOP_EFFECT_BB[sq][DIRECTION_LOWER_RIGHT];
-        Bitboard lower_right = mask & occ;
-        lower_right = reverse_bitboard(lower_right.p);
-        minus_one = lower_right.p - 1;
-        lower_right ^= minus_one;
-        lower_right = reverse_bitboard(lower_right.p);
-        lower_right &= mask;
-
-        // 左下方向
-        mask = BISHOP_EFFECT_BB[sq][DIRECTION_LOWER_LEFT];
-        Bitboard lower_left = mask & occ;
-        minus_one = lower_left.p - 1;
-        lower_left ^= minus_one;
-        lower_left &= mask;
-
-        // 左上方向
-        mask = BISHOP_EFFECT_BB[sq][DIRECTION_UPPER_LEFT];
-        Bitboard upper_left = mask & occ;
-        minus_one = upper_left.p - 1;
-        upper_left ^= minus_one;
-        upper_left &= mask;
-
-        result = upper_right | lower_right | lower_left | upper_left;
-
-        Bitboards::hash_bishop_effect[key] = result;
-        return result;
-    }
+    return bishop_effect_bb(sq, occupied_bb(COLOR_ALL));
 }
 
 Bitboard Position::rook_effect(Square sq, Color color) {
-    Bitboard occ = occupied_bb(COLOR_ALL);
-    occ &= ROOK_EFFECT_BB[sq][DIRECTION_CROSS];
-
-    // ハッシュ表を漁る
-    HASH_KEY key = Bitboards::h(sq, occ);
-    auto it = Bitboards::hash_rook_effect.find(key);
-
-    // キーが見つかった場合
-    if (it != Bitboards::hash_rook_effect.end()) {
-        Bitboard result = it->second;
-        return result;
-
-    } else {
-        Bitboard result = Bitboard(0);
-        // 右方向
-        Bitboard mask = ROOK_EFFECT_BB[sq][DIRECTION_RIGHT];
-        Bitboard right = mask & occ;
-        right = reverse_bitboard(right.p);
-        Bitboard minus_one = right.p - 1;
-        right ^= minus_one;
-        right = reverse_bitboard(right.p);
-        right &= mask;
-
-        // 上方向
-        mask = ROOK_EFFECT_BB[sq][DIRECTION_UP];
-        Bitboard up = mask & occ;
-        up = reverse_bitboard(up.p);
-        minus_one = up.p - 1;
-        up ^= minus_one;
-        up = reverse_bitboard(up.p);
-        up &= mask;
-
-        // 左方向
-        mask = ROOK_EFFECT_BB[sq][DIRECTION_LEFT];
-        Bitboard left = mask & occ;
-        minus_one = left.p - 1;
-        left ^= minus_one;
-        left &= mask;
-
-        // 下方向
-        mask = ROOK_EFFECT_BB[sq][DIRECTION_DOWN];
-        Bitboard down = mask & occ;
-        minus_one = down.p - 1;
-        down ^= minus_one;
-        down &= mask;
-
-        result = right | down | left | up;
-
-        Bitboards::hash_rook_effect[key] = result;
-        return result;
-    }
+    return rook_effect_bb(sq, occupied_bb(COLOR_ALL));
 }
 
 // 馬の利き
@@ -392,24 +543,6 @@ Bitboard Position::dragon_effect(Square sq, Color color) {
     return result;
 }
 
-// color側の全ての駒の利きを合算したBitboardを返す
-Bitboard Position::all_effect(Color color) {
-    Bitboard result = Bitboard(0);
-    for (Square sq = SQ_ZERO; sq < SQ_NB; ++sq) {
-        Piece piece = piece_board[sq];
-        if (piece == NO_PIECE) {
-            continue;
-        }
-        if (color != color_of(piece)) {
-            continue;
-        }
-        // 先後の区別をなくす
-        piece = type_of(piece);
-        result |= (this->*Piece_to_EffectFunc.at(piece))(sq, color);
-    }
-    return result;
-}
-
 // piece_boardを標準出力する
 void Position::display_piece_board() {
     char board[5][11] = {"__________", "__________", "__________", "__________",
@@ -500,49 +633,32 @@ void Position::set_captured_piece(Move &move) {
     //        "captured piece is invalid !!!");
 }
 
-Move Position::select_random_move(std::vector<Move> &move_list) {
+Move Position::select_random_move(MoveList &move_list) {
     // static std::mt19937 mt = std::mt19937(20231008);
-    static std::mt19937 mt =
-        std::mt19937(static_cast<unsigned int>(std::time(nullptr)));
+    // 探索スレッドごとに別々の乱数生成器を使う
+    thread_local std::mt19937 mt = std::mt19937(random_seed());
     // 空のリストを渡された場合（==合法手がない場合）
     if (move_list.empty()) {
         return Move(Move::NONE);
     }
-
-    Move m;
-    int random_index;
-
-    while (!move_list.empty()) {
-        random_index = mt() % move_list.size();
-        m = move_list[random_index];
-        // 安全な指し手なら返す
-        if (is_safe_move(m, side_to_move, *this)) {
-            return m;
-        }
-        // 安全でない指し手ならリストから削除してループを継続する
-        else {
-            move_list.erase(move_list.begin() + random_index);
-        }
-    }
-
-    return Move(Move::NONE);
+    // generate_legal_moves()で生成したリストなので、どの手を選んでも合法
+    return move_list[mt() % move_list.size()];
 }
 
-Move Position::select_weighted_random_move(std::vector<Move> &move_list) {
+Move Position::select_weighted_random_move(MoveList &move_list) {
     Bitboard enemy_effect = all_effect(~side_to_move);
     Bitboard our_effect = all_effect(side_to_move);
     Bitboard danger_zone = enemy_effect & ~our_effect;
-    static std::mt19937 mt =
-        std::mt19937(static_cast<unsigned int>(std::time(nullptr)));
+    thread_local std::mt19937 mt = std::mt19937(random_seed());
 
     if (move_list.empty()) {
         return Move(Move::NONE);
     }
 
-    std::vector<Move> capture_list = {};
-    std::vector<Move> check_list = {};
-    std::vector<Move> danger_list ={};
-    std::vector<Move> other_list = {};
+    MoveList capture_list;
+    MoveList check_list;
+    MoveList danger_list;
+    MoveList other_list;
 
     for (const auto &move : move_list) {
         bool is_capture = move.get_captured_piece() != NO_PIECE &&
@@ -576,11 +692,10 @@ Move Position::select_weighted_random_move(std::vector<Move> &move_list) {
     return best_move;
 }
 
-Move Position::select_by_weight(std::vector<Move> &mlist1,
-                                std::vector<Move> &mlist2, int w1, int w2) {
+Move Position::select_by_weight(MoveList &mlist1, MoveList &mlist2, int w1,
+                                int w2) {
     Move move;
-    static std::mt19937 mt =
-        std::mt19937(static_cast<unsigned int>(std::time(nullptr)));
+    thread_local std::mt19937 mt = std::mt19937(random_seed());
     int r = mt() % (w1 + w2);
     if (r < w1) {
         move = select_random_move(mlist1);
@@ -597,12 +712,9 @@ Move Position::select_by_weight(std::vector<Move> &mlist1,
     }
 }
 
-Move Position::select_by_weight(std::vector<Move> &mlist1,
-                                std::vector<Move> &mlist2,
-                                std::vector<Move> &mlist3, int w1, int w2,
-                                int w3) {
-    static std::mt19937 mt =
-        std::mt19937(static_cast<unsigned int>(std::time(nullptr)));
+Move Position::select_by_weight(MoveList &mlist1, MoveList &mlist2,
+                                MoveList &mlist3, int w1, int w2, int w3) {
+    thread_local std::mt19937 mt = std::mt19937(random_seed());
     int r = mt() % (w1 + w2 + w3);
     Move move;
     if (r < w1) {
@@ -626,13 +738,10 @@ Move Position::select_by_weight(std::vector<Move> &mlist1,
     }
 }
 
-Move Position::select_by_weight(std::vector<Move> &mlist1,
-                                std::vector<Move> &mlist2,
-                                std::vector<Move> &mlist3,
-                                std::vector<Move> &mlist4, int w1, int w2,
-                                int w3, int w4) {
-    static std::mt19937 mt =
-        std::mt19937(static_cast<unsigned int>(std::time(nullptr)));
+Move Position::select_by_weight(MoveList &mlist1, MoveList &mlist2,
+                                MoveList &mlist3, MoveList &mlist4, int w1,
+                                int w2, int w3, int w4) {
+    thread_local std::mt19937 mt = std::mt19937(random_seed());
     int r = mt() % (w1 + w2 + w3 + w4);
     Move move;
     if (r < w1) {
@@ -2,13 +2,19 @@
 
 #include "movegen.h"
 #include "zobrist.h"
-#include <map>
 #include <random>
 #include <string>
 
 struct Move;
+struct MoveList;
+namespace NNUE {
+class AccumulatorStack;
+}
 
-extern std::vector<HASH_KEY> visited_hash_keys;
+// 定義すると、差分更新したハッシュ値を毎回全計算の結果と照合する（デバッグ用）
+// #define DEBUG_HASH_KEY
+// 定義すると、差分更新した利きを毎回全計算の結果と照合する（デバッグ用）
+// #define DEBUG_EFFECT
 
 class Position {
   public:
@@ -18,21 +24,37 @@ class Position {
     Piece piece_board[SQ_NB] = {};                 // 盤上の駒の配置
     Bitboard piece_bitboards[COLOR_PIECE_NB] = {}; // 盤上の駒の配置
     Hand hands[COLOR_NB] = {};                     // 持ち駒
+    HASH_KEY hash_key = 0; // 局面のハッシュ値（指し手ごとに差分更新する）
+    // 先後それぞれの駒（盤上と持ち駒）の価値の合計（指し手ごとに差分更新する）
+    int materials[COLOR_NB] = {};
+    // 先後それぞれの駒の利き（set_piece / clear_pieceで差分更新する）
+    // effect_cnt[c][sq]はsqに利いているc側の駒の数で、effects[c]はそれが1以上の升
+    Bitboard effects[COLOR_NB] = {};
+    uint8_t effect_cnt[COLOR_NB][SQ_NB] = {};
+    // 設定されていれば、do_move / undo_moveでNNUEのアキュムレータを積む / 降ろす
+    // 探索するスレッドが自分のPositionにだけ設定する（コピーには引き継がない）
+    NNUE::AccumulatorStack *nnue = nullptr;
 
     // コンストラクタ
     Position();
     Position(const Position &pos);
+    Position &operator=(const Position &pos);
 
     // Moveを受取って盤面情報を更新する関数たち
     void do_move(const Move &move);
     void undo_move(const Move &move);
+    // 駒を動かさずに手番だけを相手に渡す（探索のnull move pruningで使う）
+    // 駒の配置は変わらないので、NNUEのアキュムレータは積まなくてよい
+    void do_null_move();
+    void undo_null_move() { do_null_move(); }
     void set_captured_piece(Move &move);
 
     // Squareを受取って盤面情報を更新する関数たち
     Piece clear_piece(Square sq);
     void set_piece(Square sq, Piece pc);
     Piece move_piece(Square from, Square to, bool is_promote);
-    void unmove_piece(Square from, Square to, bool unpromote);
+    void unmove_piece(Square from, Square to, bool unpromote,
+                      Piece captured = NO_PIECE);
 
     // 利きを計算する関数
     Bitboard pawn_effect(Square sq, Color color);
@@ -43,7 +65,16 @@ class Position {
     Bitboard king_effect(Square sq, Color color);
     Bitboard horse_effect(Square sq, Color color);
     Bitboard dragon_effect(Square sq, Color color);
-    Bitboard all_effect(Color color);
+    // color側の全ての駒の利きを合算したBitboard（差分更新したものを返すだけ）
+    Bitboard all_effect(Color color) const { return effects[color]; }
+    int effect_count(Color color, Square sq) const {
+        return effect_cnt[color][sq];
+    }
+    // 盤上の駒の配置がoccupiedのときに、sqに利いているcolor側の駒の位置
+    // 駒を動かしたあとの利きを、実際に動かさずに調べるのに使う
+    Bitboard attackers_to(Color color, Square sq, Bitboard occupied);
+    // 盤面から利きを計算し直す
+    void compute_effects();
 
     // 表示系
     void display_piece_board();
@@ -56,27 +87,64 @@ class Position {
     Square king_square(Color color);
     Bitboard occupied_bb(Color color);
     HASH_KEY get_hash_key();
+    HASH_KEY compute_hash_key();
+    int material(Color color) const { return materials[color]; }
+    void compute_materials();
 
-    // リストを渡されたら、その中からランダムに合法手を1つを選んで返す。
-    // 非合法の手しかない場合、NONEを返す。
-    Move select_random_move(std::vector<Move> &move_list);
+    // 合法手のリストを渡されたら、その中からランダムに1つを選んで返す。
+    // 空のリストの場合、NONEを返す。
+    Move select_random_move(MoveList &move_list);
     // 重みつきの手を選ぶ
-    Move select_weighted_random_move(std::vector<Move> &move_list);
-    Move select_by_weight(std::vector<Move> &mlist1, std::vector<Move> &mlist2,
-                          int w1, int w2);
-    Move select_by_weight(std::vector<Move> &mlist1, std::vector<Move> &mlist2,
-                          std::vector<Move> &mlist3, int w1, int w2, int w3);
-    Move select_by_weight(std::vector<Move> &mlist1, std::vector<Move> &mlist2,
-                          std::vector<Move> &mlist3, std::vector<Move> &mlist4,
-                          int w1, int w2, int w3, int w4);
+    Move select_weighted_random_move(MoveList &move_list);
+    Move select_by_weight(MoveList &mlist1, MoveList &mlist2, int w1, int w2);
+    Move select_by_weight(MoveList &mlist1, MoveList &mlist2, MoveList &mlist3,
+                          int w1, int w2, int w3);
+    Move select_by_weight(MoveList &mlist1, MoveList &mlist2, MoveList &mlist3,
+                          MoveList &mlist4, int w1, int w2, int w3, int w4);
+
+  private:
+    Piece replace_piece(Square sq, Piece pc);
+    // 利きの差分更新に使う関数たち
+    void add_effect(Color color, Bitboard bb);
+    void sub_effect(Color color, Bitboard bb);
+    void update_slider_effects(Square sq, Bitboard old_occupied,
+                               Bitboard new_occupied);
 };
 
+// 駒の価値を考慮した評価値を返す（0.0 ~ 1.0）
+// color側の駒の価値の合計が、盤上と持ち駒の全ての駒の価値の合計に占める割合
+inline double eval_pieces(const Position &pos, Color color) {
+    return (double)pos.material(color) /
+           (pos.material(BLACK) + pos.material(WHITE));
+}
+
+// sqにある駒pc（先後の区別あり）の、駒の配置がoccupiedのときの利き
+Bitboard piece_effect(Piece pc, Square sq, Bitboard occupied);
+
+// capturedの駒（先後の区別なし）を捕ったときに、eval_piecesが増える量の目安
+// 盤上の駒の価値は持ち駒にしたときの価値以上なので、少し多めに見積もる
+inline double eval_capture_gain(const Position &pos, Piece captured) {
+    return (double)PIECE_VALUE[captured] /
+           (pos.material(BLACK) + pos.material(WHITE));
+}
+
 // EffectFuncの定義
+// 駒種（先後の区別なし）から利きを計算するメンバ関数を引くテーブル
 typedef Bitboard (Position::*EffectFunc)(Square sq, Color color);
-inline std::map<Piece, EffectFunc> Piece_to_EffectFunc = {
-    {PAWN, &Position::pawn_effect},     {SILVER, &Position::silver_effect},
-    {GOLD, &Position::gold_effect},     {BISHOP, &Position::bishop_effect},
-    {ROOK, &Position::rook_effect},     {KING, &Position::king_effect},
-    {PRO_PAWN, &Position::gold_effect}, {PRO_SILVER, &Position::gold_effect},
-    {HORSE, &Position::horse_effect},   {DRAGON, &Position::dragon_effect},
-};
\ No newline at end of file
+inline constexpr EffectFunc Piece_to_EffectFunc[PIECE_NB] = {
+    nullptr,                  // NO_PIECE
+    &Position::gold_effect,   // GOLD
+    &Position::king_effect,   // KING
+    &Position::pawn_effect,   // PAWN
+    &Position::silver_effect, // SILVER
+    &Position::bishop_effect, // BISHOP
+    &Position::rook_effect,   // ROOK
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+    &Position::gold_effect,   // PRO_PAWN
+    &Position::gold_effect,   // PRO_SILVER
+    &Position::horse_effect,  // HORSE
+    &Position::dragon_effect, // DRAGON
+};
@@ -0,0 +1,72 @@
+#include "repetition.h"
+#include <algorithm>
+
+RepetitionStack game_history;
+
+RepetitionStack::RepetitionStack() { clear(); }
+
+void RepetitionStack::clear() {
+    entries.clear();
+    std::fill(std::begin(filter), std::end(filter), 0);
+}
+
+void RepetitionStack::push(HASH_KEY key, bool in_check) {
+    entries.push_back({key, in_check});
+    filter[filter_index(key)]++;
+}
+
+void RepetitionStack::pop() {
+    filter[filter_index(entries.back().key)]--;
+    entries.pop_back();
+}
+
+bool RepetitionStack::contains(HASH_KEY key) const {
+    if (filter[filter_index(key)] == 0) {
+        return false;
+    }
+    for (const auto &e : entries) {
+        if (e.key == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int RepetitionStack::find_repetition() const {
+    const int last = size() - 1;
+    // 最後の局面以外に、同じ下位ビットの局面が積まれていなければ繰り返しはない
+    if (last < 0 || filter[filter_index(entries[last].key)] <= 1) {
+        return -1;
+    }
+    // 手番が同じ局面（2手前、4手前、…）だけを調べればよい
+    const HASH_KEY key = entries[last].key;
+    for (int i = last - 2; i >= 0; i -= 2) {
+        if (entries[i].key == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+RepetitionState RepetitionStack::state(int prev) const {
+    const int last = size() - 1;
+    // 相手の手番の局面（prev+1, prev+3, …）で全て王手がかかっていれば、
+    // 手番側が王手をかけ続けていたことになる
+    bool our_checks = true;
+    for (int i = prev + 1; i < last && our_checks; i += 2) {
+        our_checks = entries[i].in_check;
+    }
+    // 手番側の局面（prev+2, prev+4, …, last）で全て王手がかかっていれば、
+    // 相手が王手をかけ続けていたことになる
+    bool their_checks = true;
+    for (int i = prev + 2; i <= last && their_checks; i += 2) {
+        their_checks = entries[i].in_check;
+    }
+    if (our_checks) {
+        return REPETITION_LOSE;
+    }
+    if (their_checks) {
+        return REPETITION_WIN;
+    }
+    return REPETITION_DRAW;
+}
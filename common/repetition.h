@@ -0,0 +1,52 @@
+#pragma once
+
+#include "shogi.h"
+#include <cstdint>
+#include <vector>
+
+// 千日手の判定結果（最後に積んだ局面の手番側から見たもの）
+enum RepetitionState {
+    REPETITION_NONE, // 同じ局面は現れていない
+    REPETITION_DRAW, // 千日手
+    REPETITION_WIN,  // 相手の連続王手の千日手（手番側の勝ち）
+    REPETITION_LOSE, // 自分の連続王手の千日手（手番側の負け）
+};
+
+// 局面のハッシュ値を手数の順に積んでおくスタック
+// 対局中の局面を積んだもの（game_history）を探索するスレッドごとにコピーし、
+// そこに探索中の局面をdo_moveのたびに積んで、undo_moveの前に降ろす。
+// ハッシュ値の下位ビットごとに積んである局面の数を数えておき（小さなハッシュフィルタ）、
+// 数が0なら同じ局面がないことがすぐに分かるので、ほとんどの局面はO(1)で判定できる。
+class RepetitionStack {
+  public:
+    // ハッシュフィルタの大きさ（2のべき乗）
+    static const int FILTER_SIZE = 1024;
+
+    RepetitionStack();
+    void clear();
+    // in_checkは、その局面で手番側に王手がかかっているかどうか
+    void push(HASH_KEY key, bool in_check);
+    void pop();
+    int size() const { return (int)entries.size(); }
+
+    // keyの局面が積まれているかどうか
+    bool contains(HASH_KEY key) const;
+    // 最後に積んだ局面と同じ局面のうち、最も新しいものの位置（なければ-1）
+    int find_repetition() const;
+    // 最後に積んだ局面が、位置prevの局面の繰り返しになっているときの判定結果
+    RepetitionState state(int prev) const;
+
+  private:
+    struct Entry {
+        HASH_KEY key;
+        bool in_check;
+    };
+    std::vector<Entry> entries;
+    uint16_t filter[FILTER_SIZE];
+
+    static int filter_index(HASH_KEY key) { return key & (FILTER_SIZE - 1); }
+};
+
+// 対局中に現れた局面（USIで指し手を進めるたびに積む）
+// 探索中は読むだけなので、複数のスレッドから同時に読んでもよい
+extern RepetitionStack game_history;
@@ -237,6 +237,22 @@ inline Piece operator++(Piece &pc, int) {
     return original;
 }
 
+// 駒の価値（先後の区別のない駒種で引く。持ち駒は生駒で引く）
+constexpr int PIECE_VALUE[PIECE_NB] = {
+    0,  // NO_PIECE
+    6,  // GOLD
+    0,  // KING
+    1,  // PAWN
+    5,  // SILVER
+    8,  // BISHOP
+    10, // ROOK
+    0,  0, 0, 0,
+    4,  // PRO_PAWN
+    6,  // PRO_SILVER
+    11, // HORSE
+    12, // DRAGON
+};
+
 inline Piece to_promote(Piece pc) { return (Piece)(pc | PIECE_PROMOTE); }
 inline Piece unpromote(Piece pc) { return (Piece)(pc & ~PIECE_PROMOTE); }
 inline Piece to_raw(Piece pc) { return (Piece)(unpromote(pc) & ~PIECE_WHITE); }
@@ -269,20 +285,28 @@ enum Hand : uint16_t {
     HAND_ZERO = 0,
 };
 
-// 手駒のbit位置を定義するテーブル
+// 手駒のbit位置を定義するテーブル（生駒で引く）
 // 玉は本来手駒にならないが、評価関数で用いる場合があるので、ここに含めておく。
-inline const std::map<int, int> HAND_PIECE_BITS = {
-    {PAWN, PAWN * 2}, {SILVER, SILVER * 2}, {BISHOP, BISHOP * 2},
-    {ROOK, ROOK * 2}, {GOLD, GOLD * 2},     {KING, KING * 2}};
+constexpr int HAND_PIECE_BITS[RAW_PIECE_NB] = {
+    0,          // NO_PIECE
+    GOLD * 2,   // GOLD
+    KING * 2,   // KING
+    PAWN * 2,   // PAWN
+    SILVER * 2, // SILVER
+    BISHOP * 2, // BISHOP
+    ROOK * 2,   // ROOK
+};
 
 // Piece(歩,銀,金,角,飛)を手駒に変換するテーブル
-inline const std::map<int, Hand> PIECE_TO_HAND = {
-    {PAWN, (Hand)(1 << HAND_PIECE_BITS.at(PAWN))},
-    {SILVER, (Hand)(1 << HAND_PIECE_BITS.at(SILVER))},
-    {BISHOP, (Hand)(1 << HAND_PIECE_BITS.at(BISHOP))},
-    {ROOK, (Hand)(1 << HAND_PIECE_BITS.at(ROOK))},
-    {GOLD, (Hand)(1 << HAND_PIECE_BITS.at(GOLD))},
-    {KING, (Hand)(1 << HAND_PIECE_BITS.at(KING))}};
+constexpr Hand PIECE_TO_HAND[RAW_PIECE_NB] = {
+    HAND_ZERO,
+    (Hand)(1 << HAND_PIECE_BITS[GOLD]),
+    (Hand)(1 << HAND_PIECE_BITS[KING]),
+    (Hand)(1 << HAND_PIECE_BITS[PAWN]),
+    (Hand)(1 << HAND_PIECE_BITS[SILVER]),
+    (Hand)(1 << HAND_PIECE_BITS[BISHOP]),
+    (Hand)(1 << HAND_PIECE_BITS[ROOK]),
+};
 
 // 持ち駒の枚数を表現するために必要なビット
 // 全ての駒の枚数は0～2枚なので、2bitあれば十分。
@@ -291,24 +315,24 @@ constexpr int PIECE_BIT_MASK = 0b11;
 // Handの中にあるprの枚数を返す。
 inline int hand_count(Hand hand, Piece pr) {
     // handを右シフトして、最下位ビットにマスクをかければOK
-    return (hand >> HAND_PIECE_BITS.at(pr) & PIECE_BIT_MASK);
+    return (hand >> HAND_PIECE_BITS[pr] & PIECE_BIT_MASK);
 }
 
 // 手駒prを持っているかどうかを返す。
 inline int hand_exists(Hand hand, Piece pr) {
-    return hand & (PIECE_TO_HAND.at(pr) | PIECE_TO_HAND.at(pr) << 1);
+    return hand & (PIECE_TO_HAND[pr] | PIECE_TO_HAND[pr] << 1);
 }
 
 // 手駒にprを1枚加える
 inline void add_hand(Hand &hand, Piece pr) {
-    hand = (Hand)(hand + PIECE_TO_HAND.at(pr));
+    hand = (Hand)(hand + PIECE_TO_HAND[pr]);
 }
 
 // 手駒からprを1枚減らす
 inline void sub_hand(Hand &hand, Piece pr) {
     // 送られて来たPieceが生駒であることを確認する
     // ASSERT(!is_promoted(pr), "Piece is promoted !!!");
-    hand = (Hand)(hand - PIECE_TO_HAND.at(pr));
+    hand = (Hand)(hand - PIECE_TO_HAND[pr]);
 }
 
 // 手駒を表示する(USI形式ではない) デバッグ用
@@ -0,0 +1,38 @@
+#include "timeman.h"
+#include <algorithm>
+
+void TimeManager::init(const SearchLimits &limits, Color us) {
+    start_time = std::chrono::steady_clock::now();
+    stop_flag = limits.stop;
+    is_enabled = limits.use_time_management() && !limits.infinite;
+    if (!is_enabled) {
+        return;
+    }
+
+    // 思考時間が固定の場合
+    if (limits.movetime) {
+        optimum_time = maximum_time =
+            std::max<int64_t>(limits.movetime - TIME_MARGIN, 1);
+        return;
+    }
+
+    int64_t remain = limits.time[us];
+    int64_t inc = limits.inc[us];
+    // 秒読みはその手で使い切れるので丸ごと足す
+    optimum_time = remain / MOVE_HORIZON + inc + limits.byoyomi;
+    // 難しい局面では残り時間の1/4まで使ってよい
+    maximum_time = remain / 4 + inc + limits.byoyomi;
+
+    // 時間切れにならないように、使える時間から余裕を差し引く
+    int64_t limit = std::max<int64_t>(remain + limits.byoyomi - TIME_MARGIN, 1);
+    maximum_time = std::clamp<int64_t>(maximum_time - TIME_MARGIN, 1, limit);
+    optimum_time = std::clamp<int64_t>(optimum_time - TIME_MARGIN, 1,
+                                       maximum_time);
+}
+
+int64_t TimeManager::elapsed() const {
+    auto now = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now -
+                                                                 start_time)
+        .count();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "shogi.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// goコマンドで指定される探索の制限
+struct SearchLimits {
+    int64_t time[COLOR_NB] = {0, 0}; // btime, wtime(ms)
+    int64_t inc[COLOR_NB] = {0, 0};  // binc, winc(ms)
+    int64_t byoyomi = 0;             // 秒読み(ms)
+    int64_t movetime = 0;            // 1手あたりの固定の思考時間(ms)
+    int depth = 0;                   // 探索深さの上限（0なら制限なし）
+    bool infinite = false;           // stopが来るまで考える
+    // stopコマンドを受け取るとtrueになるフラグ（USIの入力スレッドが立てる）
+    const std::atomic<bool> *stop = nullptr;
+
+    // 時間の指定があるかどうか
+    bool use_time_management() const {
+        return time[BLACK] || time[WHITE] || inc[BLACK] || inc[WHITE] ||
+               byoyomi || movetime;
+    }
+};
+
+// 通信や処理の遅れを見込んで、持ち時間から差し引いておく時間(ms)
+const int64_t TIME_MARGIN = 100;
+// 残りの持ち時間を、あと何手分に分けて使うか
+const int MOVE_HORIZON = 20;
+
+// 1手あたりの思考時間を決めて、経過時間を測るクラス
+class TimeManager {
+  public:
+    // 探索開始時に呼ぶ。ここから時間を測り始める。
+    void init(const SearchLimits &limits, Color us);
+    // 探索開始からの経過時間(ms)
+    int64_t elapsed() const;
+    // 時間制限があるかどうか
+    bool enabled() const { return is_enabled; }
+    // これを過ぎたら次の反復を始めない時間(ms)
+    int64_t optimum() const { return optimum_time; }
+    // これを過ぎたら探索を打ち切る時間(ms)
+    int64_t maximum() const { return maximum_time; }
+    // stopコマンドが来たかどうか
+    bool stop_requested() const {
+        return stop_flag != nullptr && stop_flag->load();
+    }
+
+  private:
+    std::chrono::steady_clock::time_point start_time;
+    bool is_enabled = false;
+    int64_t optimum_time = 0;
+    int64_t maximum_time = 0;
+    const std::atomic<bool> *stop_flag = nullptr;
+};
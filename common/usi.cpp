@@ -1,18 +1,24 @@
 #include "usi.h"
+#include "perft.h"
+#include "repetition.h"
 #include <bitset>
 #include <cassert>
 #include <chrono>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <thread>
 
 // コンストラクタ
 USI::USI() {
     // 初期盤面を設定する
     root = Root();
     // 初期盤面を「訪れた盤面」に追加する
-    visited_hash_keys.push_back(root.pos.get_hash_key());
+    game_history.clear();
+    game_history.push(root.pos.get_hash_key(),
+                      root.pos.is_check(root.pos.side_to_move));
 }
 
 void USI::loop() {
@@ -22,46 +28,79 @@ void USI::loop() {
         std::vector<std::string> cmds = cmd.Split();
         size_t len = cmds.size();
 
-        if (cmds[0] == "quit") {
-            break;
-        }
-
-        else if (cmds[0] == "usi") {
-            usi();
-        }
-
-        else if (cmds[0] == "isready") {
-            isready();
-        }
-        // Stateの初期盤面を設定する
-
-        else if (cmds[0] == "usinewgame")
-            continue;
-
-        else if (cmds[0] == "position") {
-            position(cmds[len - 1]);
-            std::cout << "ok" << std::endl;
-        }
-
-        else if (cmds[0] == "go") {
-            go();
-        }
-
-        else if (cmds[0] == "test") {
-            test();
-        }
-
-        else if (cmds[0] == "display") {
-            root.pos.display_bitboards();
-            root.pos.display_hands();
-        }
-
-        else if (cmds[0] == "hello") {
-            std::cout << "Hello!" << std::endl;
-        }
-
-        else {
-            std::cout << "invalid comannd: " + cmd << std::endl;
+        // 数値の引数が不正な場合（std::stoiなどが例外を投げる）は、
+        // エンジンを落とさずにそのコマンドを無視する
+        try {
+            if (cmds[0] == "quit") {
+                break;
+            }
+
+            else if (cmds[0] == "usi") {
+                usi();
+            }
+
+            else if (cmds[0] == "isready") {
+                isready();
+            }
+
+            else if (cmds[0] == "setoption") {
+                setoption(cmds);
+            }
+            // Stateの初期盤面を設定する
+
+            else if (cmds[0] == "usinewgame")
+                continue;
+
+            else if (cmds[0] == "position") {
+                position(cmds[len - 1]);
+                std::cout << "ok" << std::endl;
+            }
+
+            else if (cmds[0] == "go") {
+                go(cmds);
+                // go infiniteの探索中にquitが来た場合
+                if (quit_requested) {
+                    break;
+                }
+            }
+
+            else if (cmds[0] == "test") {
+                test();
+            }
+
+            // 指し手生成のデバッグ・計測用
+            else if (cmds[0] == "perft" && len >= 2) {
+                int depth = std::stoi(cmds[1]);
+                std::cout << "nodes: " << perft(root.pos, depth) << std::endl;
+            }
+
+            else if (cmds[0] == "divide" && len >= 2) {
+                divide(root.pos, std::stoi(cmds[1]));
+            }
+
+            else if (cmds[0] == "bench") {
+                bench(len >= 2 ? std::stoi(cmds[1]) : BENCH_DEPTH);
+            }
+
+            // プレイアウトのモデルの推論結果の検証用
+            else if (cmds[0] == "nncheck") {
+                root.check_network();
+            }
+
+            else if (cmds[0] == "display") {
+                root.pos.display_bitboards();
+                root.pos.display_hands();
+            }
+
+            else if (cmds[0] == "hello") {
+                std::cout << "Hello!" << std::endl;
+            }
+
+            else {
+                std::cout << "invalid comannd: " + cmd << std::endl;
+            }
+        } catch (const std::exception &) {
+            std::cout << "info string invalid argument: " + cmd << std::endl;
         }
     }
 }
@@ -69,11 +108,28 @@ void USI::loop() {
 void USI::usi() {
     send_id(ID_NAME);
     send_id(ID_AUTHOR);
+    root.send_options();
     send_usiok();
 }
 
 void USI::isready() { send_readyok(); }
 
+// setoption name <id> value <x>
+void USI::setoption(const std::vector<std::string> &cmds) {
+    std::string name, value;
+    for (size_t i = 1; i + 1 < cmds.size(); ++i) {
+        if (cmds[i] == "name") {
+            name = cmds[i + 1];
+        } else if (cmds[i] == "value") {
+            value = cmds[i + 1];
+        }
+    }
+    if (name.empty()) {
+        return;
+    }
+    root.set_option(name, value);
+}
+
 // commandの末尾を受け取って、Stateの盤面を更新する
 void USI::position(std::string sfen) {
     // 初期盤面のコマンドは無視する
@@ -85,7 +141,44 @@ void USI::position(std::string sfen) {
     USI::do_move(move);
 }
 
-void USI::go() { send_bestmove(); }
+// go [btime x] [wtime x] [byoyomi x] [binc x] [winc x] [movetime x]
+//    [depth x] [infinite]
+void USI::go(const std::vector<std::string> &cmds) {
+    SearchLimits limits;
+    // 値が数値でなければ、その項目は指定されなかったもの（0）として探索する
+    // （bestmoveを返さないとGUIが止まってしまうので、goごと無視はしない）
+    auto number = [](const std::string &str) -> int64_t {
+        try {
+            return std::stoll(str);
+        } catch (const std::exception &) {
+            return 0;
+        }
+    };
+    for (size_t i = 1; i < cmds.size(); ++i) {
+        const std::string &token = cmds[i];
+        bool has_value = i + 1 < cmds.size();
+        if (token == "infinite") {
+            limits.infinite = true;
+        } else if (!has_value) {
+            break;
+        } else if (token == "btime") {
+            limits.time[BLACK] = number(cmds[++i]);
+        } else if (token == "wtime") {
+            limits.time[WHITE] = number(cmds[++i]);
+        } else if (token == "binc") {
+            limits.inc[BLACK] = number(cmds[++i]);
+        } else if (token == "winc") {
+            limits.inc[WHITE] = number(cmds[++i]);
+        } else if (token == "byoyomi") {
+            limits.byoyomi = number(cmds[++i]);
+        } else if (token == "movetime") {
+            limits.movetime = number(cmds[++i]);
+        } else if (token == "depth") {
+            limits.depth = (int)number(cmds[++i]);
+        }
+    }
+    send_bestmove(limits);
+}
 
 void USI::send_id(ID id) {
     if (id == ID_NAME)
@@ -98,8 +191,22 @@ void USI::send_usiok() { std::cout << "usiok" << std::endl; }
 
 void USI::send_readyok() { std::cout << "readyok" << std::endl; }
 
-void USI::send_bestmove() {
-    Move best_move = root.search();
+void USI::send_bestmove(const SearchLimits &limits) {
+    Move best_move;
+    if (limits.infinite) {
+        // 探索は別スレッドで行い、stopかquitが来るまで標準入力を読み続ける
+        // 探索が先に終わっても、bestmoveはstopが来てから返す
+        stop_requested = false;
+        SearchLimits infinite_limits = limits;
+        infinite_limits.stop = &stop_requested;
+        std::thread search_thread(
+            [&]() { best_move = root.search(infinite_limits); });
+        wait_for_stop();
+        stop_requested = true;
+        search_thread.join();
+    } else {
+        best_move = root.search(limits);
+    }
     std::cout << "bestmove " << best_move << std::endl;
 
     if (best_move.is_resign()) {
@@ -109,14 +216,36 @@ void USI::send_bestmove() {
     USI::do_move(best_move);
 }
 
+// go infiniteの探索中に標準入力を読み、stopかquitが来たら戻る
+void USI::wait_for_stop() {
+    StringEx cmd;
+    while (std::getline(std::cin, cmd)) {
+        std::vector<std::string> cmds = cmd.Split();
+        if (cmds.empty()) {
+            continue;
+        }
+        if (cmds[0] == "stop") {
+            return;
+        } else if (cmds[0] == "quit") {
+            quit_requested = true;
+            return;
+        } else if (cmds[0] == "isready") {
+            isready();
+        }
+    }
+    // 入力が閉じられた場合も終了する
+    quit_requested = true;
+}
+
 void USI::do_move(Move move) {
     root.pos.do_move(move);
-    visited_hash_keys.push_back(root.pos.get_hash_key());
+    game_history.push(root.pos.get_hash_key(),
+                      root.pos.is_check(root.pos.side_to_move));
 }
 
 // テスト用
 void USI::test() {
     while (true) {
-        go();
+        go({"go"});
     }
 }
\ No newline at end of file
@@ -2,7 +2,10 @@
 
 #include "../common/string_ex.h"
 #include "root.h"
+#include "timeman.h"
+#include <atomic>
 #include <string>
+#include <vector>
 
 const std::string ENGINE_NAME = "shogi-engine";
 const std::string ENGINE_AUTHOR = "yu-suke";
@@ -17,12 +20,17 @@ class USI {
     void send_id(ID id);
     void send_usiok();
     void send_readyok();
-    void send_bestmove();
+    void send_bestmove(const SearchLimits &limits);
     void usi();
     void isready();
+    void setoption(const std::vector<std::string> &cmds);
     void position(std::string str);
-    void go();
+    void go(const std::vector<std::string> &cmds);
     void test();
     void do_move(Move move);
+    void wait_for_stop();
     Root root;
+    // go infiniteの探索を止めるためのフラグ
+    std::atomic<bool> stop_requested{false};
+    bool quit_requested = false;
 };
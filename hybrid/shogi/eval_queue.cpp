@@ -0,0 +1,52 @@
+#include "eval_queue.h"
+#include "node.h"
+
+int EvalQueue::push(const Position &pos, Color color) {
+    inputs.emplace_back();
+    Node::write_features(pos, inputs.back());
+    colors.push_back(color);
+    side_to_moves.push_back(pos.side_to_move);
+    return size() - 1;
+}
+
+void EvalQueue::flush() {
+    int n = size();
+    results.assign(n, -1);
+    if (n == 0) {
+        return;
+    }
+
+    // モデルが読み込まれていなければ、結果は全て-1のまま
+    // （読み込みに失敗したことは読み込み時に出力している）
+    if (Node::network.is_loaded()) {
+        std::vector<float> scores(n);
+        if (Node::network.is_quantized()) {
+            Node::network.forward_int8(inputs.data(), n, scores.data());
+        } else {
+            // floatで推論する場合はここでスケーリングする
+            std::vector<float> data((size_t)n * EVAL_INPUT_SIZE);
+            for (int b = 0; b < n; ++b) {
+                for (int i = 0; i < EVAL_INPUT_SIZE; ++i) {
+                    data[(size_t)b * EVAL_INPUT_SIZE + i] =
+                        (float)(inputs[b].v[i] * Node::scale[i]);
+                }
+            }
+            Node::network.forward(data.data(), n, scores.data());
+        }
+        // モデルの出力は手番側から見た勝率なので、colorから見た値に直す
+        for (int i = 0; i < n; ++i) {
+            results[i] =
+                colors[i] == side_to_moves[i] ? scores[i] : 1 - scores[i];
+        }
+    }
+    inputs.clear();
+    colors.clear();
+    side_to_moves.clear();
+}
+
+void EvalQueue::clear() {
+    inputs.clear();
+    colors.clear();
+    side_to_moves.clear();
+    results.clear();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "../common/position.h"
+#include "nn.h"
+#include <vector>
+
+// モデルに入力する特徴量の数（盤面25 + 先後の持ち駒6x2 + 手番1）
+const int EVAL_INPUT_SIZE = 38;
+
+// プレイアウトの機械学習モデルでまとめて評価する局面のキュー
+// 局面を1つずつ推論すると重みを何度も読み直すことになるので、
+// push()で溜めてからflush()で[N,38]の入力として1回で評価する。
+// 量子化済みのモデルなら、溜めた整数の特徴量をそのままint8で推論する。
+// rootの候補手の評価にも、探索の末端の局面の評価にも使える。
+class EvalQueue {
+  public:
+    // 局面を追加して、結果を取り出すための番号を返す
+    // colorはどちらの手番から見た評価値が欲しいか
+    int push(const Position &pos, Color color);
+    // 溜まった局面をまとめて評価する
+    void flush();
+    // push()が返した番号の局面の評価値（0.0 ~ 1.0）。flush()の後に呼ぶこと。
+    // モデルの実行に失敗した場合は-1を返す。
+    double result(int idx) const { return results[idx]; }
+    // 溜まった局面と結果を捨てる
+    void clear();
+    int size() const { return (int)colors.size(); }
+
+  private:
+    // スケーリング前の整数の特徴量（64バイト境界に揃えてある）
+    std::vector<NNInput> inputs;
+    std::vector<Color> colors;
+    std::vector<Color> side_to_moves;
+    std::vector<double> results;
+};
@@ -0,0 +1,481 @@
+#include "nn.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||             \
+    defined(_M_IX86)
+#define NN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// 関数ごとに使う命令セットを指定する（実行時にCPUを見て呼び分けるため）
+// MSVCは指定しなくても全ての命令セットの組み込み関数が使える
+#if defined(__GNUC__) || defined(__clang__)
+#define NN_TARGET(x) __attribute__((target(x)))
+#else
+#define NN_TARGET(x)
+#endif
+
+// 重みファイルの先頭に書かれている識別子
+static const char WEIGHT_FILE_MAGIC[4] = {'S', 'N', 'N', '1'};
+
+static int round_up8(int n) { return (n + 7) / 8 * 8; }
+static int round_up64(int n) { return (n + 63) / 64 * 64; }
+
+#ifdef __AVX2__
+static inline __m256 madd(__m256 a, __m256 b, __m256 c) {
+#ifdef __FMA__
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+static inline float hsum(__m256 v) {
+    __m128 s =
+        _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+#endif
+
+// 長さn（8の倍数）のベクトルの内積
+static float dot(const float *w, const float *x, int n) {
+#ifdef __AVX2__
+    // 積和の待ち時間を隠すために、部分和を4本に分ける
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        s0 = madd(_mm256_loadu_ps(w + i), _mm256_loadu_ps(x + i), s0);
+        s1 = madd(_mm256_loadu_ps(w + i + 8), _mm256_loadu_ps(x + i + 8), s1);
+        s2 = madd(_mm256_loadu_ps(w + i + 16), _mm256_loadu_ps(x + i + 16), s2);
+        s3 = madd(_mm256_loadu_ps(w + i + 24), _mm256_loadu_ps(x + i + 24), s3);
+    }
+    for (; i < n; i += 8) {
+        s0 = madd(_mm256_loadu_ps(w + i), _mm256_loadu_ps(x + i), s0);
+    }
+    return hsum(_mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+#else
+    // 8本の部分和に分けておくと、コンパイラがSIMD命令に変換しやすい
+    float sum[8] = {};
+    for (int i = 0; i < n; i += 8) {
+        for (int j = 0; j < 8; ++j) {
+            sum[j] += w[i + j] * x[i + j];
+        }
+    }
+    return ((sum[0] + sum[1]) + (sum[2] + sum[3])) +
+           ((sum[4] + sum[5]) + (sum[6] + sum[7]));
+#endif
+}
+
+// 重みの1行wと4局面分の入力xの内積をまとめて計算する
+// wを1回読むだけで4局面分の計算ができる
+static void dot4(const float *w, const float *x, int stride, int n,
+                 float *out) {
+#ifdef __AVX2__
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+    for (int i = 0; i < n; i += 8) {
+        __m256 wv = _mm256_loadu_ps(w + i);
+        s0 = madd(wv, _mm256_loadu_ps(x + i), s0);
+        s1 = madd(wv, _mm256_loadu_ps(x + stride + i), s1);
+        s2 = madd(wv, _mm256_loadu_ps(x + 2 * stride + i), s2);
+        s3 = madd(wv, _mm256_loadu_ps(x + 3 * stride + i), s3);
+    }
+    out[0] = hsum(s0);
+    out[1] = hsum(s1);
+    out[2] = hsum(s2);
+    out[3] = hsum(s3);
+#else
+    for (int b = 0; b < 4; ++b) {
+        out[b] = dot(w, x + b * stride, n);
+    }
+#endif
+}
+
+// 長さn（64の倍数）のuint8とint8のベクトルの内積
+// uint8側は0~127に収めているので、隣り合う2つの積の和がint16に収まる
+static int32_t dot_u8s8_scalar(const uint8_t *x, const int8_t *w, int n) {
+    int32_t sum[8] = {};
+    for (int i = 0; i < n; i += 8) {
+        for (int j = 0; j < 8; ++j) {
+            sum[j] += (int32_t)x[i + j] * w[i + j];
+        }
+    }
+    return ((sum[0] + sum[1]) + (sum[2] + sum[3])) +
+           ((sum[4] + sum[5]) + (sum[6] + sum[7]));
+}
+
+#ifdef NN_X86
+static NN_TARGET("avx2") int32_t
+    dot_u8s8_avx2(const uint8_t *x, const int8_t *w, int n) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < n; i += 32) {
+        // 32要素の積を隣同士で足してint16x16に、さらに隣同士で足してint32x8に
+        __m256i p = _mm256_maddubs_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w + i)));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(p, ones));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                              _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+static NN_TARGET("avx512f,avx512bw") int32_t
+    dot_u8s8_avx512(const uint8_t *x, const int8_t *w, int n) {
+    const __m512i ones = _mm512_set1_epi16(1);
+    __m512i sum = _mm512_setzero_si512();
+    for (int i = 0; i < n; i += 64) {
+        __m512i p = _mm512_maddubs_epi16(_mm512_loadu_si512(x + i),
+                                         _mm512_loadu_si512(w + i));
+        sum = _mm512_add_epi32(sum, _mm512_madd_epi16(p, ones));
+    }
+    alignas(64) int32_t lanes[16];
+    _mm512_store_si512(lanes, sum);
+    int32_t total = 0;
+    for (int j = 0; j < 16; ++j) {
+        total += lanes[j];
+    }
+    return total;
+}
+#endif
+
+struct Int8Kernel {
+    const char *name;
+    int32_t (*dot)(const uint8_t *x, const int8_t *w, int n);
+};
+
+// 実行中のCPUが対応している中で最も速いint8の内積の実装を選ぶ
+static Int8Kernel select_int8_kernel() {
+#if defined(NN_X86) && (defined(__GNUC__) || defined(__clang__))
+    // 静的変数の初期化はmain()より前なので、明示的に初期化しておく
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512bw")) {
+        return {"avx512", dot_u8s8_avx512};
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return {"avx2", dot_u8s8_avx2};
+    }
+#elif defined(NN_X86) && defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 0);
+    int max_leaf = r[0];
+    __cpuid(r, 1);
+    // OSがYMM/ZMMレジスタを保存してくれるか（OSXSAVE）も確かめる
+    bool osxsave = (r[2] >> 27) & 1;
+    if (max_leaf >= 7 && osxsave) {
+        unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(r, 7, 0);
+        bool avx2 = (r[1] >> 5) & 1;
+        bool avx512 = ((r[1] >> 16) & 1) && ((r[1] >> 30) & 1);
+        if (avx512 && (xcr0 & 0xe6) == 0xe6) {
+            return {"avx512", dot_u8s8_avx512};
+        }
+        if (avx2 && (xcr0 & 0x6) == 0x6) {
+            return {"avx2", dot_u8s8_avx2};
+        }
+    }
+#endif
+    return {"scalar", dot_u8s8_scalar};
+}
+
+static const Int8Kernel int8_kernel = select_int8_kernel();
+
+template <typename T> static bool read(std::ifstream &ifs, T *p, size_t n) {
+    ifs.read(reinterpret_cast<char *>(p), sizeof(T) * n);
+    return (bool)ifs;
+}
+
+// 重みファイルの形式（リトルエンディアン）
+//   char    magic[4]  "SNN1"
+//   uint32  層の数
+//   各層:   uint32 入力数, uint32 出力数, float 重み[出力数][入力数],
+//           float バイアス[出力数]
+//   uint32  検証用の入出力の数
+//   各入出力: float 入力[最初の層の入力数], float 出力
+void PlayoutNetwork::clear() {
+    layers.clear();
+    qlayers.clear();
+    sample_inputs.clear();
+    sample_outputs.clear();
+}
+
+bool PlayoutNetwork::load(const std::string &path) {
+    clear();
+
+    std::ifstream ifs(path, std::ios::binary);
+    char magic[4];
+    uint32_t layer_cnt;
+    if (!read(ifs, magic, 4) ||
+        std::memcmp(magic, WEIGHT_FILE_MAGIC, 4) != 0 ||
+        !read(ifs, &layer_cnt, 1) || layer_cnt == 0) {
+        return false;
+    }
+
+    std::vector<Layer> new_layers(layer_cnt);
+    for (uint32_t l = 0; l < layer_cnt; ++l) {
+        Layer &layer = new_layers[l];
+        uint32_t size[2];
+        if (!read(ifs, size, 2) || size[0] == 0 || size[1] == 0) {
+            return false;
+        }
+        layer.in_size = size[0];
+        layer.out_size = size[1];
+        layer.stride = round_up8(layer.in_size);
+        // 前の層の出力数と入力数が一致しなければ壊れたファイル
+        if (l > 0 && new_layers[l - 1].out_size != layer.in_size) {
+            return false;
+        }
+        std::vector<float> w((size_t)layer.in_size * layer.out_size);
+        layer.bias.resize(layer.out_size);
+        if (!read(ifs, w.data(), w.size()) ||
+            !read(ifs, layer.bias.data(), layer.bias.size())) {
+            return false;
+        }
+        layer.weight.assign((size_t)layer.stride * layer.out_size, 0.0f);
+        for (int o = 0; o < layer.out_size; ++o) {
+            std::copy(w.begin() + (size_t)o * layer.in_size,
+                      w.begin() + (size_t)(o + 1) * layer.in_size,
+                      layer.weight.begin() + (size_t)o * layer.stride);
+        }
+    }
+    if (new_layers.back().out_size != 1) {
+        return false;
+    }
+
+    // 検証用の入出力（省略されていてもよい）
+    uint32_t sample_cnt = 0;
+    if (read(ifs, &sample_cnt, 1)) {
+        std::vector<float> in((size_t)sample_cnt * new_layers[0].in_size);
+        std::vector<float> out(sample_cnt);
+        if (!read(ifs, in.data(), in.size()) ||
+            !read(ifs, out.data(), out.size())) {
+            return false;
+        }
+        sample_inputs = std::move(in);
+        sample_outputs = std::move(out);
+    }
+
+    layers = std::move(new_layers);
+    return true;
+}
+
+void PlayoutNetwork::forward(const float *inputs, int n, float *outputs) const {
+    if (n <= 0) {
+        return;
+    }
+    int max_stride = 0;
+    for (auto &layer : layers) {
+        max_stride = std::max(max_stride, round_up8(layer.out_size));
+        max_stride = std::max(max_stride, layer.stride);
+    }
+    // 各層の入力と出力（[n][stride]、端数は0で埋める）
+    std::vector<float> x((size_t)n * max_stride, 0.0f);
+    std::vector<float> y((size_t)n * max_stride, 0.0f);
+    const int in_size = layers[0].in_size;
+    for (int b = 0; b < n; ++b) {
+        std::copy(inputs + (size_t)b * in_size,
+                  inputs + (size_t)(b + 1) * in_size,
+                  x.begin() + (size_t)b * layers[0].stride);
+    }
+
+    for (size_t l = 0; l < layers.size(); ++l) {
+        const Layer &layer = layers[l];
+        const bool is_last = l + 1 == layers.size();
+        const int out_stride = is_last ? 1 : layers[l + 1].stride;
+        std::fill(y.begin(), y.begin() + (size_t)n * out_stride, 0.0f);
+        // 重みの1行を読み込んだら、全ての局面について使い回す
+        for (int o = 0; o < layer.out_size; ++o) {
+            const float *w = &layer.weight[(size_t)o * layer.stride];
+            float v[4];
+            for (int b = 0; b < n; b += 4) {
+                int cnt = std::min(4, n - b);
+                const float *xb = &x[(size_t)b * layer.stride];
+                if (cnt == 4) {
+                    dot4(w, xb, layer.stride, layer.stride, v);
+                } else {
+                    for (int k = 0; k < cnt; ++k) {
+                        v[k] = dot(w, xb + k * layer.stride, layer.stride);
+                    }
+                }
+                for (int k = 0; k < cnt; ++k) {
+                    float u = v[k] + layer.bias[o];
+                    // 中間層はReLU、出力層はsigmoid
+                    y[(size_t)(b + k) * out_stride + o] =
+                        is_last ? 1.0f / (1.0f + std::exp(-u))
+                                : std::max(u, 0.0f);
+                }
+            }
+        }
+        std::swap(x, y);
+    }
+    for (int b = 0; b < n; ++b) {
+        outputs[b] = x[b];
+    }
+}
+
+float PlayoutNetwork::verify() const {
+    int n = sample_cnt();
+    if (!is_loaded() || n == 0) {
+        return 0;
+    }
+    std::vector<float> out(n);
+    forward(sample_inputs.data(), n, out.data());
+    float max_error = 0;
+    for (int i = 0; i < n; ++i) {
+        max_error = std::max(max_error, std::fabs(out[i] - sample_outputs[i]));
+    }
+    return max_error;
+}
+
+void PlayoutNetwork::quantize(const std::vector<double> &scale) {
+    qlayers.clear();
+    if (!is_loaded() || (int)scale.size() != input_size() ||
+        round_up64(input_size()) != NN_INPUT_STRIDE) {
+        return;
+    }
+    input_scale = scale;
+    // 特徴量ごとに整数倍して0~127に広げ、その分を重みで割っておく
+    // （スケーリングを畳み込むだけだと盤面の特徴量の重みが粗くなるため）
+    // 例えば盤面の駒（0~30）は4倍、持ち駒の枚数（0~2）は63倍、手番は127倍
+    input_mul.assign(NN_INPUT_STRIDE, 0);
+    for (int i = 0; i < input_size(); ++i) {
+        long max_raw = scale[i] > 0 ? std::lround(1 / scale[i]) : 127;
+        input_mul[i] = (uint8_t)std::max(1L, 127 / std::max(max_raw, 1L));
+    }
+
+    std::vector<QuantizedLayer> new_layers;
+    for (size_t l = 0; l < layers.size(); ++l) {
+        const Layer &layer = layers[l];
+        QuantizedLayer q;
+        q.in_size = layer.in_size;
+        q.out_size = layer.out_size;
+        q.stride = round_up64(layer.in_size);
+        q.weight.assign((size_t)q.stride * q.out_size, 0);
+        q.scale.resize(q.out_size);
+        q.bias = layer.bias;
+        std::vector<float> w(q.in_size);
+        for (int o = 0; o < q.out_size; ++o) {
+            float max_w = 0;
+            for (int i = 0; i < q.in_size; ++i) {
+                w[i] = layer.weight[(size_t)o * layer.stride + i];
+                // 最初の層は特徴量のスケーリングの係数を重みに畳み込む
+                if (l == 0) {
+                    w[i] *= (float)(scale[i] / input_mul[i]);
+                }
+                max_w = std::max(max_w, std::fabs(w[i]));
+            }
+            float s = max_w > 0 ? max_w / 127 : 1.0f;
+            q.scale[o] = s;
+            for (int i = 0; i < q.in_size; ++i) {
+                q.weight[(size_t)o * q.stride + i] =
+                    (int8_t)std::lround(w[i] / s);
+            }
+        }
+        new_layers.push_back(std::move(q));
+    }
+    qlayers = std::move(new_layers);
+}
+
+void PlayoutNetwork::forward_int8(const NNInput *inputs, int n,
+                                  float *outputs) const {
+    if (n <= 0) {
+        return;
+    }
+    int max_stride = 0;
+    for (auto &q : qlayers) {
+        max_stride = std::max(max_stride, q.stride);
+    }
+    // 各層の入力（[n][stride]）と、局面ごとの量子化の幅
+    // 最初の層の入力は特徴量を整数倍しただけなので幅は1
+    std::vector<uint8_t> x((size_t)n * max_stride);
+    std::vector<float> x_scale(n, 1.0f);
+    std::vector<float> y;
+    for (int b = 0; b < n; ++b) {
+        uint8_t *xb = &x[(size_t)b * NN_INPUT_STRIDE];
+        for (int i = 0; i < NN_INPUT_STRIDE; ++i) {
+            xb[i] = (uint8_t)std::min(inputs[b].v[i] * input_mul[i], 127);
+        }
+    }
+
+    for (size_t l = 0; l < qlayers.size(); ++l) {
+        const QuantizedLayer &q = qlayers[l];
+        const bool is_last = l + 1 == qlayers.size();
+        const uint8_t *xl = x.data();
+        y.assign((size_t)n * q.out_size, 0.0f);
+        // 重みの1行を読み込んだら、全ての局面について使い回す
+        for (int o = 0; o < q.out_size; ++o) {
+            const int8_t *w = &q.weight[(size_t)o * q.stride];
+            for (int b = 0; b < n; ++b) {
+                int32_t acc = int8_kernel.dot(xl + (size_t)b * q.stride, w,
+                                              q.stride);
+                float u = acc * x_scale[b] * q.scale[o] + q.bias[o];
+                // 中間層はReLU、出力層はsigmoid
+                y[(size_t)b * q.out_size + o] =
+                    is_last ? 1.0f / (1.0f + std::exp(-u)) : std::max(u, 0.0f);
+            }
+        }
+        if (is_last) {
+            break;
+        }
+
+        // 次の層の入力を、局面ごとに最大値が127になるように量子化する
+        const int next_stride = qlayers[l + 1].stride;
+        for (int b = 0; b < n; ++b) {
+            const float *yb = &y[(size_t)b * q.out_size];
+            uint8_t *xb = &x[(size_t)b * next_stride];
+            float max_y = *std::max_element(yb, yb + q.out_size);
+            float s = max_y > 0 ? max_y / 127 : 1.0f;
+            x_scale[b] = s;
+            for (int o = 0; o < q.out_size; ++o) {
+                xb[o] = (uint8_t)std::lround(yb[o] / s);
+            }
+            std::fill(xb + q.out_size, xb + next_stride, 0);
+        }
+    }
+    for (int b = 0; b < n; ++b) {
+        outputs[b] = y[b];
+    }
+}
+
+float PlayoutNetwork::verify_int8() const {
+    int n = sample_cnt();
+    if (!is_quantized() || n == 0) {
+        return 0;
+    }
+    // 検証用の入力をスケーリング前の整数に直し、floatでも同じ入力で推論して比べる
+    const int in_size = input_size();
+    std::vector<NNInput> q_in(n);
+    std::vector<float> f_in((size_t)n * in_size);
+    for (int b = 0; b < n; ++b) {
+        for (int i = 0; i < in_size; ++i) {
+            float v = sample_inputs[(size_t)b * in_size + i];
+            long raw = std::lround(v / input_scale[i]);
+            raw = std::min(std::max(raw, 0L), 127L);
+            q_in[b].v[i] = (uint8_t)raw;
+            f_in[(size_t)b * in_size + i] = (float)(raw * input_scale[i]);
+        }
+    }
+    std::vector<float> q_out(n), f_out(n);
+    forward_int8(q_in.data(), n, q_out.data());
+    forward(f_in.data(), n, f_out.data());
+    float max_error = 0;
+    for (int i = 0; i < n; ++i) {
+        max_error = std::max(max_error, std::fabs(q_out[i] - f_out[i]));
+    }
+    return max_error;
+}
+
+const char *PlayoutNetwork::int8_kernel_name() { return int8_kernel.name; }
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// int8で推論するときの1局面分の入力の要素数（特徴量の数を64の倍数に切り上げたもの）
+const int NN_INPUT_STRIDE = 64;
+
+// int8で推論するときの1局面分の入力
+// スケーリング前の整数の特徴量（駒の種類や持ち駒の枚数）をそのまま詰める。
+// スケーリングの係数はquantize()で最初の層の重みに畳み込んでおく。
+struct alignas(64) NNInput {
+    uint8_t v[NN_INPUT_STRIDE];
+};
+
+// プレイアウトの機械学習モデル（training/shogi_nn.pyのShogiNN）をCPUで推論するクラス
+// libtorchは使わず、training/export_weights.pyで書き出した重みファイルを読み込む。
+// 構造は「全結合 -> ReLU」を繰り返し、最後の全結合の後にsigmoidをかけるMLP。
+class PlayoutNetwork {
+  public:
+    // 重みファイルを読み込む。失敗した場合はfalseを返す。
+    bool load(const std::string &path);
+    // 読み込んだ重みを捨てて、読み込む前の状態に戻す
+    void clear();
+    bool is_loaded() const { return !layers.empty(); }
+    int input_size() const { return layers.empty() ? 0 : layers[0].in_size; }
+    // n局面分の入力（[n, input_size()]）をまとめて推論して、outputs[n]に書き込む
+    void forward(const float *inputs, int n, float *outputs) const;
+    // 重みファイルに含まれる検証用の入出力を推論し、TorchScriptの出力との
+    // 最大誤差を返す。検証用のデータがなければ0を返す。
+    float verify() const;
+    int sample_cnt() const { return (int)sample_outputs.size(); }
+
+    // 読み込んだ重みをint8に量子化する（学習後の量子化）
+    // input_scaleは各特徴量にかける係数で、最初の層の重みに畳み込まれる。
+    void quantize(const std::vector<double> &input_scale);
+    bool is_quantized() const { return !qlayers.empty(); }
+    // int8の重みを捨てて、floatで推論するように戻す
+    void dequantize() { qlayers.clear(); }
+    // int8の重みでn局面分の入力をまとめて推論して、outputs[n]に書き込む
+    void forward_int8(const NNInput *inputs, int n, float *outputs) const;
+    // 検証用の入力をint8とfloatの両方で推論し、出力の最大誤差を返す
+    float verify_int8() const;
+    // 実行中のCPUで使われるint8の内積の実装の名前（"avx512", "avx2", "scalar"）
+    static const char *int8_kernel_name();
+
+  private:
+    struct Layer {
+        int in_size;
+        int out_size;
+        // 重みの1行の要素数。SIMDで端数処理をしなくて済むように、
+        // in_sizeを8の倍数に切り上げて0で埋めている。
+        int stride;
+        std::vector<float> weight; // [out_size][stride]
+        std::vector<float> bias;   // [out_size]
+    };
+    std::vector<Layer> layers;
+    // int8に量子化した層
+    // 重みは出力ごとに|w|の最大値が127になるように量子化し、その幅をscaleに持つ。
+    // 層への入力は局面ごとに最大値が127になるように0~127のuint8に量子化する。
+    struct QuantizedLayer {
+        int in_size;
+        int out_size;
+        int stride; // in_sizeを64の倍数に切り上げたもの
+        std::vector<int8_t> weight; // [out_size][stride]
+        std::vector<float> scale;   // [out_size]
+        std::vector<float> bias;    // [out_size]
+    };
+    std::vector<QuantizedLayer> qlayers;
+    std::vector<double> input_scale;
+    // 最初の層の入力にする前に、各特徴量にかける整数
+    std::vector<uint8_t> input_mul; // [NN_INPUT_STRIDE]
+    // 検証用の入出力（export_weights.pyがTorchScriptで計算したもの）
+    std::vector<float> sample_inputs;
+    std::vector<float> sample_outputs;
+};
@@ -1,4 +1,7 @@
 #include "node.h"
+#include "../common/nnue.h"
+#include "../common/repetition.h"
+#include "eval_queue.h"
 #include <algorithm>
 #include <cmath>
 // #include <torch/cuda.h>
@@ -6,10 +9,9 @@
 #include <filesystem>
 
 int node_cnt = 0;
-torch::jit::script::Module Node::model;
-bool Node::is_model_loaded = false;
+PlayoutNetwork Node::network;
 
-Node::Node(Position pos, Move &move, int depth) {
+Node::Node(Position pos, Move move, int depth) {
     this->pos = pos;
     this->move = move;
     this->depth = depth;
@@ -18,15 +20,9 @@ Node::Node(Position pos, Move &move, int depth) {
     // NONEはROOTノードの場合にのみ渡される。
     // ROOTノードは既に指し手を実行した後なのでこの処理をスキップする。
     if (!this->move.is_none()) {
-        if (!is_safe_move(move, pos.side_to_move, pos)) {
-            this->score = -INFTY;
-            this->is_illegal = true;
-        }
         this->pos.do_move(move);
         // もしこの指し手が一度訪れた盤面だったら千日手対策として違法手にする
-        HASH_KEY hash_key = this->pos.get_hash_key();
-        if (std::find(visited_hash_keys.begin(), visited_hash_keys.end(),
-                      hash_key) != visited_hash_keys.end()) {
+        if (game_history.contains(this->pos.get_hash_key())) {
             this->score = -INFTY;
             this->is_illegal = true;
         }
@@ -35,8 +31,81 @@ Node::Node(Position pos, Move &move, int depth) {
 
 Node::~Node() {}
 
+// 手番側から見た局面の評価値（0 ~ 1）
+// （ノードごとに局面をコピーしているので、NNUEは差分ではなく全計算になる）
+static double evaluate(Position &pos) {
+    return NNUE::is_loaded() ? NNUE::evaluate(pos)
+                             : eval_pieces(pos, pos.side_to_move);
+}
+
+// 駒を捕る手（depthが0なら王手も）だけを読む静止探索
+// depthは0から1手ごとに1ずつ減っていく（-depthが静止探索に入ってからの手数）
+// 手番側から見た評価値（0 ~ 1）を返す。posは読み終わったら元に戻っている
+static double qsearch(Position &pos, double alpha, double beta, int depth) {
+    // hybridには探索中の千日手の検出がないので、王手の応酬で
+    // 際限なく読み進めないように手数で打ち切る
+    if (depth <= -QSEARCH_MAX_PLY) {
+        return evaluate(pos);
+    }
+    const bool in_check = pos.is_check(pos.side_to_move);
+    double best_score = -INFTY;
+    double stand_pat = -INFTY;
+    MoveList move_list;
+    if (in_check) {
+        // 王手されていたら全ての手で受ける（受けがなければ詰み）
+        generate_legal_moves(pos, move_list);
+    } else {
+        // 王手されていなければ、何もしない（＝今の評価値で止める）こともできる
+        stand_pat = evaluate(pos);
+        if (stand_pat >= beta) {
+            return stand_pat;
+        }
+        alpha = std::max(alpha, stand_pat);
+        best_score = stand_pat;
+        generate_legal_moves(pos, move_list, GEN_CAPTURES);
+        // 王手は静止探索の最初の手だけ読む
+        if (depth == 0) {
+            generate_quiet_checks(pos, move_list);
+        }
+    }
+    sort_move_list(move_list, pos);
+
+    for (auto move : move_list) {
+        // デルタ枝刈り：駒を丸得しても、αに届かない手は読まない
+        Piece captured = move.get_captured_piece();
+        if (!in_check && captured != NO_PIECE &&
+            stand_pat + eval_capture_gain(pos, captured) + DELTA_MARGIN <=
+                alpha) {
+            continue;
+        }
+        pos.do_move(move);
+        // 対局中に一度訪れた盤面になる手は千日手対策として指さない
+        if (game_history.contains(pos.get_hash_key())) {
+            pos.undo_move(move);
+            continue;
+        }
+        double value = 1 - qsearch(pos, 1 - beta, 1 - alpha, depth - 1);
+        pos.undo_move(move);
+        if (value > best_score) {
+            best_score = value;
+            if (value > alpha) {
+                alpha = value;
+                if (alpha >= beta) {
+                    break;
+                }
+            }
+        }
+    }
+
+    // 王手を受ける手がない（＝詰み）
+    if (best_score == -INFTY) {
+        return PLAYER_LOSE;
+    }
+    return best_score;
+}
+
 double Node::search(double beta) {
-    std::vector<Move> move_list = generate_move_list(pos);
+    MoveList move_list = generate_legal_moves(pos);
     if (move_list.size() == 0) {
         // 指し手がない（＝詰み）の場合は前の手番側の勝ち
         // より浅い詰みを選ぶために深さで割る
@@ -47,7 +116,18 @@ double Node::search(double beta) {
     // 深さの上限に達していたらこのノードの評価値を返す
     // 「『前の手番』から見たこのノードの評価値」を返すのが適切！！
     if (depth == MAX_DEPTH) {
-        this->score = eval_pieces(~pos.side_to_move);
+        // 駒の取り合いが落ち着くまで静止探索で読む
+        // 静止探索は手番側から見た値を返すので、前の手番から見た値に直す
+        // 返す値が-β以下なら親ノードでは使われないので、静止探索の窓を狭める
+        // （ただし、モデルの評価値と混ぜる場合は正確な値が要る）
+        const double offset = depth % 2 == 0 ? 1 : 0;
+        const double q_beta =
+            leaf_playout_score >= 0 ? INFTY : 1 - offset + beta;
+        this->score = 1 - qsearch(pos, -INFTY, q_beta, 0);
+        if (leaf_playout_score >= 0) {
+            this->score = (1 - LEAF_PLAYOUT_WEIGHT) * this->score +
+                          LEAF_PLAYOUT_WEIGHT * leaf_playout_score;
+        }
         // rootから見た子の評価値が正になるように符号調整
         if (depth % 2 == 0) {
             this->score -= 1;
@@ -59,9 +139,16 @@ double Node::search(double beta) {
     // α：子ノードの評価値の最大値
     double alpha = -INFTY;
     double value = -1;
-    for (auto move : move_list) {
+    std::vector<std::unique_ptr<Node>> leaves;
+    if (depth + 1 == MAX_DEPTH && LEAF_PLAYOUT_WEIGHT > 0 &&
+        network.is_loaded()) {
+        leaves = create_leaves(move_list);
+    }
+    for (size_t i = 0; i < move_list.size(); ++i) {
         std::unique_ptr<Node> child =
-            std::make_unique<Node>(pos, move, depth + 1);
+            leaves.empty()
+                ? std::make_unique<Node>(pos, move_list[i], depth + 1)
+                : std::move(leaves[i]);
         if (child->is_illegal) {
             continue;
         }
@@ -90,34 +177,6 @@ double Node::search(double beta) {
     return this->score;
 }
 
-// 駒の価値を考慮した評価値を返す（0.0 ~ 1.0）
-double Node::eval_pieces(const Color color) {
-    double total_piece_value = 0;
-    double piece_value[COLOR_NB] = {0, 0};
-    for (Square sq = SQ_ZERO; sq < SQ_NB; ++sq) {
-        Piece piece = pos.piece_board[sq];
-        if (piece == NO_PIECE) {
-            continue;
-        }
-        piece_value[color_of(piece)] += PIECE_VALUE_MAP.at(type_of(piece));
-        total_piece_value += PIECE_VALUE_MAP.at(type_of(piece));
-    }
-    // 手札にある駒の枚数を数え上げる
-    for (int c = BLACK; c < COLOR_NB; ++c) {
-        for (Piece pr = RAW_PIECE_BEGIN; pr < RAW_PIECE_NB; ++pr) {
-            int num = hand_count(pos.hands[c], (Piece)pr);
-            ASSERT(0 <= num && num <= 2, "Number of hand is invalid");
-            piece_value[c] += num * PIECE_VALUE_MAP.at(pr);
-            total_piece_value += num * PIECE_VALUE_MAP.at(pr);
-        }
-    }
-    // 0.0 ~ 1.0に正規化
-    double piece_val = piece_value[color] / total_piece_value;
-    ASSERT(0 <= piece_val && piece_val <= 1.0, "eval_pieces() is invalid");
-
-    return piece_val;
-}
-
 bool Node::compare(const Node *a, const Node *b) { return b->score < a->score; }
 
 bool Node::compare(const std::unique_ptr<Node> &a,
@@ -155,7 +214,7 @@ std::ostream &operator<<(std::ostream &os,
 double Node::playout(Color color) {
     while (true) {
         // 手番側の可能な指し手を1つランダムにとってくる
-        std::vector<Move> mlist = generate_move_list(pos);
+        MoveList mlist = generate_legal_moves(pos);
         // Move move = pos.select_weighted_random_move(mlist);
         Move move = pos.select_random_move(mlist);
 
@@ -174,7 +233,7 @@ double Node::playout(Color color) {
     }
     // 勝負がついていなければ、駒の枚数に応じた評価値を返す
     // player優勢なら1に近く、opponent優勢なら0に近い値を返す
-    return eval_pieces(color);
+    return eval_pieces(pos, color);
 }
 
 double Node::calc_playout_score(Color color) {
@@ -202,54 +261,50 @@ double Node::calc_playout_score(Color color) {
     return current_score;
 }
 
-torch::Tensor Node::create_tensor() {
-    std::vector<double> data = create_board_array();
-    for (int i = 0; i < scale.size(); ++i) {
-        data[i] *= scale[i];
-    }
-
-    torch::Tensor tensor = torch::from_blob(data.data(), {38}, torch::kFloat64);
-    tensor = tensor.toType(torch::kFloat);
-    tensor = tensor.view({1, -1});
-    // std::cout << tensor << std::endl;
-
-    return tensor;
-}
-
-std::vector<double> Node::create_board_array() {
-    std::vector<double> data = {};
+void Node::write_features(const Position &pos, NNInput &input) {
+    int i = 0;
     for (Square sq = SQ_ZERO; sq < SQ_NB; ++sq) {
-        data.push_back(pos.piece_board[sq]);
+        input.v[i++] = (uint8_t)pos.piece_board[sq];
     }
     for (Color c = COLOR_ZERO; c < COLOR_NB; ++c) {
         for (Piece pr = RAW_PIECE_BEGIN; pr < RAW_PIECE_NB; ++pr) {
-            data.push_back(hand_count(pos.hands[c], pr));
+            input.v[i++] = (uint8_t)hand_count(pos.hands[c], pr);
         }
     }
-    data.push_back(pos.side_to_move);
-
-    return data;
+    input.v[i++] = (uint8_t)pos.side_to_move;
+    ASSERT(i == EVAL_INPUT_SIZE, "invalid input size");
+    // 端数は0で埋めておく（SIMDでまとめて内積を取るため）
+    std::fill(input.v + i, input.v + NN_INPUT_STRIDE, 0);
 }
 
 double Node::eval_playout_score(Color color) {
-    torch::Tensor t = create_tensor();
-    // std::cout << t << std::endl;
-    double score = 0;
-    try {
-        at::Tensor output = model.forward({t}).toTensor();
-        score = output.item<double>();
-        // std::cout << score << std::endl;
-    } catch (const c10::Error &e) {
-        std::cout << "An error occurred while running the model: " << e.what()
-                  << std::endl;
-        return -1;
+    // 1局面だけのバッチとして評価する
+    EvalQueue queue;
+    int idx = queue.push(pos, color);
+    queue.flush();
+    return queue.result(idx);
+}
+
+std::vector<std::unique_ptr<Node>>
+Node::create_leaves(const MoveList &move_list) {
+    std::vector<std::unique_ptr<Node>> leaves;
+    EvalQueue queue;
+    std::vector<int> indices;
+    for (auto move : move_list) {
+        leaves.push_back(std::make_unique<Node>(pos, move, depth + 1));
+        // 末端では「前の手番」（＝このノードの手番）から見た評価値を使う
+        indices.push_back(leaves.back()->is_illegal
+                              ? -1
+                              : queue.push(leaves.back()->pos,
+                                           pos.side_to_move));
     }
-    // std::cout << score << std::endl;
-    if (color == pos.side_to_move) {
-        return score;
-    } else {
-        return 1 - score;
+    queue.flush();
+    for (size_t i = 0; i < leaves.size(); ++i) {
+        if (indices[i] >= 0) {
+            leaves[i]->leaf_playout_score = queue.result(indices[i]);
+        }
     }
+    return leaves;
 }
 
 Node *Node::get_best_child() {
@@ -300,25 +355,48 @@ const std::vector<double> Node::scale = {0.03333333333333333,
                                          1.0};
 
 int Node::load_model() {
-    // bool is_cuda_available = torch::cuda::is_available();
-    // std::cout << "Is CUDA Available: " << is_cuda_available << std::endl;
+    // 重みファイルはtraining/export_weights.pyで書き出したもの
     std::string path_to_model = "../shogi/";
-    std::string model_name = "playout_model.pt";
-    if (!is_model_loaded) {
-        try {
-            model = torch::jit::load(path_to_model + model_name);
-            model.eval();
-            is_model_loaded = true;
-            std::cout << "Successfully loaded the model: " << model_name
-                      << std::endl;
-            return 0;
-        } catch (const c10::Error &) {
-            ;
-        }
-        std::cout<< "Current path: " << std::filesystem::current_path() << std::endl;
-        std::cout << "An error occurred while loading the model: " << model_name
+    std::string model_name = "playout_model.bin";
+    if (network.is_loaded()) {
+        return 0;
+    }
+    // 標準出力はUSIの通信に使うので、メッセージはinfo stringで出す
+    if (!network.load(path_to_model + model_name) ||
+        network.input_size() != EVAL_INPUT_SIZE) {
+        network.clear();
+        std::cout << "info string failed to load the model: " << model_name
+                  << " (current path: " << std::filesystem::current_path()
+                  << ")" << std::endl;
+        return -1;
+    }
+    // 書き出し時にTorchScriptで計算した出力と一致するか確かめる
+    float error = network.verify();
+    if (error > NN_VERIFY_TOLERANCE) {
+        network.clear();
+        std::cout << "info string the model does not match TorchScript: "
+                  << model_name << " (max error " << error << ")"
                   << std::endl;
         return -1;
     }
+    std::cout << "info string loaded the model: " << model_name << std::endl;
+    if (network.sample_cnt() > 0) {
+        std::cout << "info string max error against TorchScript: " << error
+                  << " (" << network.sample_cnt() << " samples)" << std::endl;
+    }
+    if (USE_INT8_NETWORK) {
+        network.quantize(scale);
+        float int8_error = network.verify_int8();
+        std::cout << "info string int8 kernel: "
+                  << PlayoutNetwork::int8_kernel_name()
+                  << ", max error against float: " << int8_error << std::endl;
+        // 量子化で誤差が大きくなりすぎた場合（入力の飽和など）はfloatで推論する
+        if (int8_error > NN_INT8_VERIFY_TOLERANCE) {
+            network.dequantize();
+            std::cout << "info string int8 error exceeds "
+                      << NN_INT8_VERIFY_TOLERANCE << ", using float inference"
+                      << std::endl;
+        }
+    }
     return 0;
-}
\ No newline at end of file
+}
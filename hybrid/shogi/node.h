@@ -1,9 +1,9 @@
 #pragma once
 
 #include "../common/position.h"
+#include "nn.h"
 #include "params.h"
 #include <filesystem>
-#include <torch/script.h>
 #include <vector>
 
 extern int node_cnt;
@@ -15,10 +15,12 @@ class Node {
     int depth = 1;
     double score = INFTY;
     bool is_illegal = false;
+    // 末端のノードでモデルが出した評価値（まだ評価していなければ-1）
+    double leaf_playout_score = -1;
     std::vector<std::unique_ptr<Node>> children = {};
     std::unique_ptr<Node> best_child;
 
-    Node(Position pos, Move &move, int depth = 0);
+    Node(Position pos, Move move, int depth = 0);
     ~Node();
 
     double playout(Color color);
@@ -26,21 +28,22 @@ class Node {
     static bool compare(const Node *a, const Node *b);
     static bool compare(const std::unique_ptr<Node> &a,
                         const std::unique_ptr<Node> &b);
-    static bool Node::compare(const Node &a, const Node &b);
+    static bool compare(const Node &a, const Node &b);
     Node *get_best_child();
+    // 末端になる子ノードをまとめて作り、モデルでまとめて評価しておく
+    std::vector<std::unique_ptr<Node>> create_leaves(const MoveList &move_list);
 
     // 評価関数
     double calc_playout_score(
         Color color); // 実際にプレイアウトを行って評価値を計算する
-    double eval_pieces(Color color); // 駒の価値をもとに評価値を計算する
     double eval_playout_score(
         Color color); // プレイアウトの機械学習モデルを使って評価値を計算する
 
     // モデルの読み込み関連
-    static bool is_model_loaded;
-    static torch::jit::script::Module model;
-    std::vector<double> create_board_array();
-    torch::Tensor create_tensor();
+    // モデルを使えるかどうかはnetwork.is_loaded()で判定する
+    static PlayoutNetwork network;
+    // モデルに入力する特徴量（スケーリング前の整数）をinputに書き込む
+    static void write_features(const Position &pos, NNInput &input);
     static int load_model();
     static const std::vector<double> scale;
 
@@ -1,19 +1,30 @@
 #pragma once
 #include "../common/shogi.h"
-#include <map>
 
 const double INFTY = 10000;
 
 // 深さは原則偶数にすること
-const int MAX_DEPTH = 6;
+const int MAX_DEPTH = 4;
 const double PLAYER_WIN = 1;
 const double PLAYER_LOSE = 0;
 
 // プレイアウトの結果をどの程度参考にするか
 const double PLAYOUT_WEIGHT = 0.2;
+// 探索の末端の局面でモデルの評価値をどの程度参考にするか（0なら使わない）
+// 末端の局面を全てモデルで評価するので、探索が遅くなる点に注意
+const double LEAF_PLAYOUT_WEIGHT = 0.0;
+// プレイアウトのモデルをint8に量子化して推論する
+const bool USE_INT8_NETWORK = true;
+// 重みファイルの検証用の入力を推論したときに、TorchScriptの出力との誤差の許容値
+// これを超えたら推論の実装か重みファイルが壊れているので、モデルを使わない
+const float NN_VERIFY_TOLERANCE = 1e-4f;
+// int8で推論した出力と、floatで推論した出力の誤差の許容値（出力は0 ~ 1の勝率）
+// これを超えたら量子化がうまくいっていないので、floatで推論する
+const float NN_INT8_VERIFY_TOLERANCE = 1e-2f;
 
-// 各駒の価値を定義
-inline std::map<Piece, int> PIECE_VALUE_MAP = {
-    {PAWN, 1}, {SILVER, 5},   {GOLD, 6},       {BISHOP, 8}, {ROOK, 10},
-    {KING, 0}, {PRO_PAWN, 4}, {PRO_SILVER, 6}, {HORSE, 11}, {DRAGON, 12},
-};
+// 静止探索のデルタ枝刈りの余裕（評価値の幅）
+// 静的評価値に捕る駒の価値とこの余裕を足してもαに届かない駒を捕る手は読まない
+const double DELTA_MARGIN = 0.05;
+// 静止探索で読む手数の上限
+// 王手の応酬が続いても探索が止まるように、これより先は評価値で打ち切る
+const int QSEARCH_MAX_PLY = 16;
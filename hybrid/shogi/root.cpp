@@ -1,17 +1,82 @@
 #include "root.h"
+#include "../common/nnue.h"
+#include "eval_queue.h"
 #include <algorithm>
 #include <random>
 
 Root::Root() {
     pos = Position();
     // ノードの評価にプレイアウトの機械学習モデルを使う場合、モデルを読み込む
-    if (Node::is_model_loaded == false) {
+    // 読み込みに失敗した場合も、何度も読み直さないようにする
+    static bool load_tried = false;
+    if (!load_tried) {
         Node::load_model();
-        Node::is_model_loaded = true;
+        load_tried = true;
     }
 }
 
-Move Root::search() {
+void Root::send_options() {
+    // 末端の評価関数の選択：NNUEの重みファイルを指定すればNNUE、空なら駒の価値
+    std::cout << "option name EvalFile type string default <empty>"
+              << std::endl;
+}
+
+void Root::set_option(const std::string &name, const std::string &value) {
+    if (name != "EvalFile") {
+        return;
+    }
+    if (value.empty() || value == "<empty>") {
+        NNUE::load("");
+    } else if (NNUE::load(value)) {
+        std::cout << "info string NNUE: " << value << std::endl;
+    } else {
+        std::cout << "info string failed to read NNUE: " << value
+                  << std::endl;
+    }
+}
+
+// 重みファイルの検証用の入出力で、推論結果がTorchScriptの出力と
+// 許容誤差の範囲で一致し、int8で推論した出力もfloatと許容誤差の範囲で
+// 一致すればtrueを返す（nncheckコマンド用）
+bool Root::check_network() {
+    const PlayoutNetwork &network = Node::network;
+    if (!network.is_loaded()) {
+        std::cout << "the model is not loaded" << std::endl;
+    } else if (network.sample_cnt() == 0) {
+        std::cout << "the model has no samples to verify" << std::endl;
+    }
+    bool passed = network.is_loaded() && network.sample_cnt() > 0;
+    if (passed) {
+        float error = network.verify();
+        std::cout << "max error against TorchScript: " << error << " ("
+                  << network.sample_cnt()
+                  << " samples, tolerance: " << NN_VERIFY_TOLERANCE << ")"
+                  << std::endl;
+        passed = error <= NN_VERIFY_TOLERANCE;
+    }
+    // 対局ではint8で推論するので、量子化した重みも確かめる
+    // 読み込み時にfloatに戻していても、同じ手順で量子化し直して誤差を出す
+    if (passed && USE_INT8_NETWORK) {
+        PlayoutNetwork quantized = network;
+        quantized.quantize(Node::scale);
+        if (!quantized.is_quantized()) {
+            std::cout << "failed to quantize the model" << std::endl;
+            passed = false;
+        } else {
+            float error = quantized.verify_int8();
+            std::cout << "int8 kernel: " << PlayoutNetwork::int8_kernel_name()
+                      << ", max error against float: " << error
+                      << " (tolerance: " << NN_INT8_VERIFY_TOLERANCE << ")"
+                      << std::endl;
+            passed = error <= NN_INT8_VERIFY_TOLERANCE;
+        }
+    }
+    std::cout << "result: " << (passed ? "passed" : "FAILED") << std::endl;
+    return passed;
+}
+
+// 今のところ探索量は固定なので、limitsは使わない
+Move Root::search([[maybe_unused]] const SearchLimits &limits) {
     std::unique_ptr<Node> root = std::make_unique<Node>(pos, Move(Move::NONE));
     root->search(INFTY);
 
@@ -38,18 +103,31 @@ Move Root::search() {
         }
     }
 
+    // 機械学習モデルで簡易的に評価したプレイアウトスコア
+    // 全ての候補手のbest_childを1回のforwardでまとめて評価する
+    EvalQueue queue;
+    std::vector<int> queue_idx;
+    for (auto &child : candidates) {
+        queue_idx.push_back(
+            queue.push(child->get_best_child()->pos, pos.side_to_move));
+    }
+    queue.flush();
+
     std::cout << "=== SCORE ===\n";
     // それぞれのbest_childのプレイアウトスコアを計算して、元のスコアと平均する
-    for (auto &child : candidates) {
-        // 機械学習モデルで簡易的に評価したプレイアウトスコア
-        double best_child_score =
-            child->get_best_child()->eval_playout_score(pos.side_to_move);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        auto &child = candidates[i];
+        double best_child_score = queue.result(queue_idx[i]);
         // 実際にプレイアウトを行って評価したプレイアウトスコア
         // double best_child_score =
         // child->get_best_child()->calc_playout_score(pos.side_to_move);
-        Node *best_child = child->get_best_child();
         // 元のスコア
         std::cout << child->move << ": " << child->score;
+        // モデルで評価できなかった場合は元のスコアをそのまま使う
+        if (best_child_score < 0) {
+            std::cout << "\n";
+            continue;
+        }
         child->score = child->score * (1 - PLAYOUT_WEIGHT) +
                        best_child_score * PLAYOUT_WEIGHT;
         std::cout << " -> " << child->score << "\n";
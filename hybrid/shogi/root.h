@@ -1,9 +1,15 @@
 #include "../common/position.h"
+#include "../common/timeman.h"
 #include "node.h"
 #include <iomanip>
 class Root {
   public:
     Root();
     Position pos;
-    Move search();
+    Move search(const SearchLimits &limits);
+    // USIのオプション
+    void send_options();
+    void set_option(const std::string &name, const std::string &value);
+    // プレイアウトのモデルの推論結果がTorchScriptと一致するか確かめる
+    bool check_network();
 };
@@ -0,0 +1,62 @@
+"""
+学習済みのプレイアウトのモデル（TorchScript）を、エンジンが読み込める重みファイルに書き出す。
+
+使い方:
+    python export_weights.py ./models/model4_xxxx.pt ../hybrid/shogi/playout_model.bin
+
+重みファイルの形式（リトルエンディアン）は hybrid/shogi/nn.cpp を参照。
+エンジン側の推論結果を確かめられるように、ランダムな入力とTorchScriptでの出力も書き込む。
+"""
+import struct
+import sys
+
+import torch
+
+from shogi_nn import INPUT_SIZE
+
+MAGIC = b"SNN1"
+# 検証用に書き込む入出力の数
+SAMPLE_CNT = 16
+
+
+def linear_layers(model):
+    # state_dictのキーは "layers.<番号>.weight" の形式なので、番号順に並べる
+    state = model.state_dict()
+    indices = sorted({int(key.split(".")[1])
+                     for key in state if key.endswith(".weight")})
+    return [(state[f"layers.{i}.weight"], state[f"layers.{i}.bias"])
+            for i in indices]
+
+
+def export(model_path, out_path):
+    model = torch.jit.load(model_path, map_location="cpu")
+    model.eval()
+    layers = linear_layers(model)
+
+    # 学習時と同じく0~1に正規化された入力を想定する
+    torch.manual_seed(0)
+    samples = torch.rand(SAMPLE_CNT, INPUT_SIZE)
+    with torch.no_grad():
+        outputs = model(samples).reshape(-1)
+
+    with open(out_path, "wb") as f:
+        f.write(MAGIC)
+        f.write(struct.pack("<I", len(layers)))
+        for weight, bias in layers:
+            out_size, in_size = weight.shape
+            f.write(struct.pack("<II", in_size, out_size))
+            f.write(weight.float().contiguous().numpy().astype("<f4").tobytes())
+            f.write(bias.float().contiguous().numpy().astype("<f4").tobytes())
+        f.write(struct.pack("<I", SAMPLE_CNT))
+        f.write(samples.numpy().astype("<f4").tobytes())
+        f.write(outputs.float().numpy().astype("<f4").tobytes())
+
+    shapes = ", ".join(f"{w.shape[1]}->{w.shape[0]}" for w, _ in layers)
+    print(f"Exported {len(layers)} layers ({shapes}) to {out_path}")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print("usage: python export_weights.py <model.pt> <out.bin>")
+        sys.exit(1)
+    export(sys.argv[1], sys.argv[2])
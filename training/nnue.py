@@ -0,0 +1,189 @@
+"""
+ab / hybridの評価関数（NNUE）を学習し、エンジンが読み込める重みファイルに書き出す。
+
+使い方:
+    python nnue.py <学習データ> [<学習データ> ...] <出力先.nnue>
+
+学習データは次のどちらか（混ぜてもよい）:
+  - プレイアウトのデータと同じJSON（{"X": 盤面の配列, "Y": 勝率}）
+  - abエンジンのTrainingDataFileオプションで書き出したテキスト
+    （1行1局面、盤面の配列38個と手番側の勝率を空白区切りで並べたもの）
+盤面の配列は「盤上の駒25個、先後の持ち駒6種類ずつ、手番」の順。
+
+特徴量・ネットワークの構造・量子化の方法は common/nnue.h, common/nnue.cpp と
+一致させること。エンジン側では、USIのsetoption name EvalFileで読み込む。
+"""
+import json
+import struct
+import sys
+
+import torch
+import torch.nn as nn
+import torch.optim as optim
+
+MAGIC = b"SNU1"
+
+SQ_NB = 25
+PIECE_TYPE_NB = 10
+BOARD_FEATURE_NB = PIECE_TYPE_NB * 2 * SQ_NB
+HAND_TYPE_NB = 5
+HAND_MAX = 2
+FEATURES_PER_KING = BOARD_FEATURE_NB + HAND_TYPE_NB * 2 * HAND_MAX
+FEATURE_NB = SQ_NB * FEATURES_PER_KING
+HALF_DIMS = 64
+HIDDEN_DIMS = 32
+
+# 量子化の幅（common/nnue.cppと同じ）
+ACTIVATION_MAX = 127
+WEIGHT_SCALE = 64
+
+# 駒の種類（先後の区別なし）-> 特徴量の番号
+PIECE_TYPE_INDEX = {1: 0, 2: 1, 3: 2, 4: 3, 5: 4, 6: 5,
+                    11: 6, 12: 7, 13: 8, 14: 9}
+# 持ち駒の並び（GOLD, KING, PAWN, SILVER, BISHOP, ROOK）-> 特徴量の番号
+HAND_TYPE_INDEX = [0, None, 1, 2, 3, 4]
+KING = 2
+PIECE_WHITE = 16
+
+lr = 0.001
+batch_size = 256
+num_epochs = 30
+
+
+def oriented(sq, perspective):
+    return sq if perspective == 0 else SQ_NB - 1 - sq
+
+
+def active_features(x, perspective):
+    """盤面の配列xについて、perspective側の視点で値が1の特徴量の番号を返す"""
+    board, hands = x[:SQ_NB], x[SQ_NB:SQ_NB + 12]
+    king = next(sq for sq, pc in enumerate(board)
+                if pc == KING + perspective * PIECE_WHITE)
+    offset = oriented(king, perspective) * FEATURES_PER_KING
+    features = []
+    for sq, pc in enumerate(board):
+        if pc == 0:
+            continue
+        side = 0 if (pc & PIECE_WHITE) >> 4 == perspective else 1
+        index = side * PIECE_TYPE_NB + PIECE_TYPE_INDEX[pc & ~PIECE_WHITE]
+        features.append(offset + index * SQ_NB + oriented(sq, perspective))
+    for owner in range(2):
+        side = 0 if owner == perspective else 1
+        for i, index in enumerate(HAND_TYPE_INDEX):
+            if index is None:
+                continue
+            for k in range(min(hands[owner * 6 + i], HAND_MAX)):
+                features.append(offset + BOARD_FEATURE_NB +
+                                (side * HAND_TYPE_NB + index) * HAND_MAX + k)
+    return features
+
+
+def load_data(paths):
+    X, Y = [], []
+    for path in paths:
+        if path.endswith(".json"):
+            with open(path, "r") as f:
+                data = json.load(f)
+            X += [[int(v) for v in x] for x in data["X"]]
+            Y += [float(y) for y in data["Y"]]
+        else:
+            with open(path, "r") as f:
+                for line in f:
+                    values = line.split()
+                    if len(values) == 39:
+                        X.append([int(v) for v in values[:38]])
+                        Y.append(float(values[38]))
+    return X, Y
+
+
+class NNUE(nn.Module):
+    def __init__(self):
+        super(NNUE, self).__init__()
+        self.ft = nn.EmbeddingBag(FEATURE_NB, HALF_DIMS, mode="sum")
+        self.ft_bias = nn.Parameter(torch.zeros(HALF_DIMS))
+        self.l1 = nn.Linear(2 * HALF_DIMS, HIDDEN_DIMS)
+        self.out = nn.Linear(HIDDEN_DIMS, 1)
+        nn.init.normal_(self.ft.weight, std=0.05)
+
+    def forward(self, us, us_offsets, them, them_offsets):
+        # 手番側の視点を前半、相手側の視点を後半に並べる（エンジンと同じ）
+        a = self.ft(us, us_offsets) + self.ft_bias
+        b = self.ft(them, them_offsets) + self.ft_bias
+        x = torch.clamp(torch.cat([a, b], dim=1), 0.0, 1.0)
+        x = torch.clamp(self.l1(x), 0.0, 1.0)
+        return torch.sigmoid(self.out(x)).reshape(-1)
+
+
+def make_batch(X):
+    inputs = []
+    for perspective_of in (lambda x: x[37], lambda x: 1 - x[37]):
+        indices, offsets = [], []
+        for x in X:
+            offsets.append(len(indices))
+            indices += active_features(x, perspective_of(x))
+        inputs += [torch.tensor(indices, dtype=torch.long),
+                   torch.tensor(offsets, dtype=torch.long)]
+    return inputs
+
+
+def train(X, Y):
+    model = NNUE()
+    optimizer = optim.Adam(model.parameters(), lr=lr)
+    criterion = nn.MSELoss()
+    for epoch in range(num_epochs):
+        perm = torch.randperm(len(X)).tolist()
+        total = 0.0
+        for i in range(0, len(X), batch_size):
+            idx = perm[i:i + batch_size]
+            inputs = make_batch([X[j] for j in idx])
+            targets = torch.tensor([Y[j] for j in idx], dtype=torch.float32)
+            optimizer.zero_grad()
+            loss = criterion(model(*inputs), targets)
+            loss.backward()
+            optimizer.step()
+            total += loss.item() * len(idx)
+        print(f"epoch {epoch + 1}: loss {total / len(X):.6f}")
+    return model
+
+
+def quantize(tensor, scale, dtype, lo, hi):
+    return torch.clamp(torch.round(tensor * scale), lo, hi).to(dtype)
+
+
+def export(model, out_path):
+    """common/nnue.cppのload()が読み込める形式で書き出す"""
+    with torch.no_grad():
+        ft_bias = quantize(model.ft_bias, ACTIVATION_MAX, torch.int16,
+                           -32768, 32767)
+        ft_weight = quantize(model.ft.weight, ACTIVATION_MAX, torch.int16,
+                             -32768, 32767)
+        l1_bias = quantize(model.l1.bias, ACTIVATION_MAX * WEIGHT_SCALE,
+                           torch.int32, -2**31, 2**31 - 1)
+        l1_weight = quantize(model.l1.weight, WEIGHT_SCALE, torch.int8,
+                             -128, 127)
+        out_bias = quantize(model.out.bias, ACTIVATION_MAX * WEIGHT_SCALE,
+                            torch.int32, -2**31, 2**31 - 1)
+        out_weight = quantize(model.out.weight, WEIGHT_SCALE, torch.int8,
+                              -128, 127)
+
+    with open(out_path, "wb") as f:
+        f.write(MAGIC)
+        f.write(struct.pack("<III", FEATURE_NB, HALF_DIMS, HIDDEN_DIMS))
+        f.write(ft_bias.numpy().astype("<i2").tobytes())
+        f.write(ft_weight.contiguous().numpy().astype("<i2").tobytes())
+        f.write(l1_bias.numpy().astype("<i4").tobytes())
+        f.write(l1_weight.contiguous().numpy().astype("i1").tobytes())
+        f.write(out_bias.numpy().astype("<i4").tobytes())
+        f.write(out_weight.reshape(-1).numpy().astype("i1").tobytes())
+    print(f"Exported NNUE ({FEATURE_NB}->{HALF_DIMS}x2->{HIDDEN_DIMS}->1) "
+          f"to {out_path}")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print("usage: python nnue.py <data> [<data> ...] <out.nnue>")
+        sys.exit(1)
+    X, Y = load_data(sys.argv[1:-1])
+    print("Data size:", len(X))
+    model = train(X, Y)
+    export(model, sys.argv[-1])
@@ -3,46 +3,76 @@
 #include "../common/movegen.h"
 #include "../common/position.h"
 #include "params.h"
+#include <atomic>
+#include <thread>
 #include <vector>
 
 const int UCB_UNREACHED = 100000;
-const int NODE_ILLEGAL = -99999;
 const int SCORE_MAX = 1234567890;
 
-extern int node_cnt;
-extern double total_explore;
-extern double total_exploit;
-extern int max_depth;
+// 探索の統計情報（複数のスレッドから更新される）
+extern std::atomic<int> max_depth;
 
+// ノードに埋め込むための1byteのスピンロック
+// 初回訪問時の処理と子ノードの展開はすぐ終わるので、mutexより軽いこちらを使う
+class SpinLock {
+  public:
+    void lock() {
+        while (flag.test_and_set(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+    void unlock() { flag.clear(std::memory_order_release); }
+
+  private:
+    std::atomic_flag flag = ATOMIC_FLAG_INIT;
+};
+
+// ノードの状態
+enum NodeState : uint8_t {
+    NODE_UNVISITED,   // まだ一度も訪れていない
+    NODE_INITIALIZED, // 駒の価値を計算済み（子ノードは未展開）
+    NODE_EXPANDED,    // 子ノードを展開済み
+};
+
+// UCTの木のノード
+// ノードはNodePoolからまとめて確保し、盤面は持たずに指し手だけを持つ。
+// 盤面はrootから指し手を実行しながら辿ることで復元する。
 class Node {
   public:
-    Color player_color; // rootの手番の色
-    Position pos;
-    Move move; // このノードに来た時に実行する指し手
-    std::vector<Node *> children = {};
-    int play_cnt = 0;
+    // 子ノードの配列（NodePool上で連続している）
+    // 展開後は変更しないので、stateがNODE_EXPANDEDならロックなしで読める
+    Node *children = nullptr;
     // このノードの勝率。ただし前の手番側から見た勝率である。
-    double score = 0;
+    // 探索中のスレッドの分は、仮想的な負け(VIRTUAL_LOSS)が足されている。
+    std::atomic<double> score{0};
+    // 訪問回数。探索中のスレッドの分も含む。
+    std::atomic<int> play_cnt{0};
     // このノードが持つ駒の価値。ただし前の手番側から見た価値である。
-    double node_piece_value = 0;
-    int depth = 0;           // rootからの深さ
-    bool is_illegal = false; // 違法手かどうか
-
-    Node(Color player_color, Position pos, Move &move, int depth = 0);
-    ~Node(); // デストラクタ
+    std::atomic<float> node_piece_value{0};
+    Move move = Move(Move::NONE); // このノードに来た時に実行する指し手
+    uint16_t child_cnt = 0;       // 子ノードの数
+    uint8_t depth = 0;            // rootからの深さ
+    std::atomic<uint8_t> state{NODE_UNVISITED};
+    // 手番側に指せる手がない（＝前の手番側の勝ち）かどうか
+    std::atomic<bool> is_mated{false};
 
-    double search();
-    double do_playout();
+    // posはこのノードの指し手を実行した後の盤面、player_colorはrootの手番の色
+    double search(Position &pos, Color player_color);
+    double do_playout(const Position &pos, Color player_color);
     Node *select_child();
     double ucb(int parent_play_cnt);
     double rate() const;
     static bool compare(const Node *a, const Node *b);
-    double playout();
-    double eval_pieces(const Color color_us);
+    static double playout(Position &pos);
 
   private:
+    double search_node(Position &pos, Color player_color);
+    void expand(Position &pos);
+    // 初回訪問時の処理と、子ノードの展開を他のスレッドから守る
+    SpinLock spin_lock;
 };
 
 // Nodeの標準出力用
 std::ostream &operator<<(std::ostream &os, const Node &node);
-std::ostream &operator<<(std::ostream &os, const std::vector<Node *> &nodes);
\ No newline at end of file
+std::ostream &operator<<(std::ostream &os, const std::vector<Node *> &nodes);
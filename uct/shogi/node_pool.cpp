@@ -0,0 +1,77 @@
+#include "node_pool.h"
+#include <new>
+#include <type_traits>
+
+// clear()ではデストラクタを呼ばないので、Nodeは何も所有してはいけない
+static_assert(std::is_trivially_destructible<Node>::value,
+              "Node must be trivially destructible");
+
+NodePool node_pool;
+
+Node *NodePool::allocate(int n) {
+    ASSERT(0 < n && n <= (int)NODE_BLOCK_SIZE, "invalid node count: " << n);
+    std::lock_guard<std::mutex> lock(mtx);
+    // 今のブロックに収まらなければ次のブロックへ進む
+    if (blocks.empty() || used + n > NODE_BLOCK_SIZE) {
+        if (!blocks.empty()) {
+            block_idx++;
+        }
+        if (block_idx == blocks.size()) {
+            blocks.emplace_back(new Node[NODE_BLOCK_SIZE]);
+        }
+        used = 0;
+    }
+    Node *p = &blocks[block_idx][used];
+    // 前回の探索で使われていたかもしれないので、初期状態に戻す
+    for (int i = 0; i < n; ++i) {
+        new (p + i) Node();
+    }
+    used += n;
+    allocated += n;
+    return p;
+}
+
+void NodePool::clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    block_idx = 0;
+    used = 0;
+    allocated = 0;
+}
+
+size_t NodePool::size() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return allocated;
+}
+
+Node *NodePool::copy_tree(const Node &src) {
+    Node *root = allocate(1);
+    copy_node(src, *root, 0);
+    return root;
+}
+
+void NodePool::copy_node(const Node &src, Node &dst, int depth) {
+    dst.score = src.score.load();
+    dst.play_cnt = src.play_cnt.load();
+    dst.node_piece_value = src.node_piece_value.load();
+    dst.move = src.move;
+    dst.depth = depth;
+    dst.state = src.state.load();
+    dst.is_mated = src.is_mated.load();
+    if (src.state != NODE_EXPANDED || src.child_cnt == 0) {
+        return;
+    }
+    // 兄弟ノードは連続した領域に確保し直す
+    dst.children = allocate(src.child_cnt);
+    dst.child_cnt = src.child_cnt;
+    for (int i = 0; i < src.child_cnt; ++i) {
+        copy_node(src.children[i], dst.children[i], depth + 1);
+    }
+}
+
+void NodePool::swap(NodePool &other) {
+    std::scoped_lock lock(mtx, other.mtx);
+    std::swap(blocks, other.blocks);
+    std::swap(block_idx, other.block_idx);
+    std::swap(used, other.used);
+    std::swap(allocated, other.allocated);
+}
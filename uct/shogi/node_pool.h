@@ -0,0 +1,38 @@
+#pragma once
+
+#include "node.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// 1ブロックあたりのノード数
+const size_t NODE_BLOCK_SIZE = 1 << 16;
+
+// UCTの木のノードをまとめて確保するメモリプール
+// 兄弟ノードを連続した領域に確保し、木全体を一度に解放する。
+// ブロックは解放せずに次の探索で使い回す。
+class NodePool {
+  public:
+    // n個の連続したノードを確保する（複数のスレッドから呼んでよい）
+    Node *allocate(int n);
+    // 全てのノードを一度に解放する（探索中に呼んではいけない）
+    void clear();
+    // 使用中のノード数
+    size_t size();
+    // srcを根とする部分木を、このプールに深さ0からの木として写す
+    // 木の使い回しで、不要になった兄弟ノードを捨てるために使う
+    Node *copy_tree(const Node &src);
+    // 2つのプールの中身を入れ替える（探索中に呼んではいけない）
+    void swap(NodePool &other);
+
+  private:
+    void copy_node(const Node &src, Node &dst, int depth);
+
+    std::mutex mtx;
+    std::vector<std::unique_ptr<Node[]>> blocks;
+    size_t block_idx = 0; // 使用中のブロック
+    size_t used = 0;      // 使用中のブロックで確保済みのノード数
+    size_t allocated = 0; // 確保済みのノード数（ブロック末尾の余りを除く）
+};
+
+extern NodePool node_pool;
@@ -1,6 +1,5 @@
 #pragma once
 #include "../common/shogi.h"
-#include <map>
 
 // const int UCT_LOOP_MAX = 3000; // UCTアルゴリズムの探索回数
 
@@ -17,6 +16,17 @@ const int PLAYOUT_LOOP_MAX = 10;
 const int UCT_PER_MOVE = 1000; // 駒打ち以外の指し手1手あたりの探索回数
 const int UCT_PER_DROP = 300; // 駒打ち1手あたりの探索回数
 
+// 前回の探索の木を何手先まで辿って使い回すか（自分の手と相手の手で2手）
+const int REUSE_MAX_PLY = 2;
+
+// 探索スレッド数のデフォルト値。USIのsetoption name Threadsで変更できる。
+// 探索回数（UCT_PER_MOVE, UCT_PER_DROPから決まる）を全スレッドで分け合う。
+const int THREAD_NUM = 1;
+const int MAX_THREAD_NUM = 256;
+// 探索中のノードに一時的に加える負けの大きさ。
+// 他のスレッドが同じノードに集中しないようにするためのもの。
+const double VIRTUAL_LOSS = 1.0;
+
 // ucbが、「node自体が持つ駒の価値」を重視する割合。
 // この値を大きくすると、駒を捕る手に探索が集中する。
 const double UCB_PIECE_WEIGHT = 0.2;
@@ -30,8 +40,3 @@ const double PLAYOUT_PIECE_WEIGHT = 1.0;
 // UCBのexplore項の係数。これを大きくすると探索が広がり、小さくすると探索が狭まる。
 // 0.3くらいが、探索が広がりすぎず、かつ狭まりすぎず、ちょうどいい気がする。
 const double C = 0.3;
-
-inline std::map<Piece, int> PIECE_VALUE_MAP = {
-    {PAWN, 1}, {SILVER, 5},   {GOLD, 6},       {BISHOP, 8}, {ROOK, 10},
-    {KING, 0}, {PRO_PAWN, 4}, {PRO_SILVER, 6}, {HORSE, 11}, {DRAGON, 12},
-};
\ No newline at end of file
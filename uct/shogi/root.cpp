@@ -1,12 +1,91 @@
 #include "root.h"
 #include <algorithm>
+#include <thread>
+
+// 木を使い回すときに、残す部分木を写すためのプール
+static NodePool spare_pool;
 
 Root::Root() { pos = Position(); }
 
-Move Root::search() {
-    Move m = Move(Move::RESIGN);
-    Node *root = new Node(pos.side_to_move, pos, m, 0);
-    std::vector<Move> move_list = generate_move_list(pos);
+void Root::send_options() {
+    std::cout << "option name Threads type spin default " << THREAD_NUM
+              << " min 1 max " << MAX_THREAD_NUM << std::endl;
+}
+
+void Root::set_option(const std::string &name, const std::string &value) {
+    if (name == "Threads") {
+        thread_num = std::clamp(std::stoi(value), 1, MAX_THREAD_NUM);
+    }
+}
+
+// この探索部はプレイアウトのモデルを使わないので、確かめるものがない
+bool Root::check_network() {
+    std::cout << "this engine has no playout network" << std::endl;
+    return true;
+}
+
+// 前回の探索の木から、今の局面に対応するノードを探す
+// node_posはnodeの盤面。REUSE_MAX_PLY手先まで探す。
+// ノードの評価値は前回のrootの手番から見た値なので、
+// 手番が同じになる偶数手先のノードだけを使い回す
+Node *Root::find_node(Node *node, Position &node_pos, int ply) {
+    if ((ply & 1) == 0 && node_pos.get_hash_key() == pos.get_hash_key()) {
+        return node;
+    }
+    if (ply == REUSE_MAX_PLY || node->state != NODE_EXPANDED) {
+        return nullptr;
+    }
+    for (int i = 0; i < node->child_cnt; ++i) {
+        Node *child = &node->children[i];
+        node_pos.do_move(child->move);
+        Node *found = find_node(child, node_pos, ply + 1);
+        node_pos.undo_move(child->move);
+        if (found != nullptr) {
+            return found;
+        }
+    }
+    return nullptr;
+}
+
+// 探索に使うrootノードを用意する
+// 前回の木に今の局面があれば、その部分木だけを残して使い回す
+Node *Root::prepare_root() {
+    Node *found = nullptr;
+    if (tree_root != nullptr) {
+        found = find_node(tree_root, tree_pos, 0);
+    }
+    reused_visits = 0;
+    Node *root;
+    if (found != nullptr) {
+        // 部分木を別のプールに写してから、前回の木をまとめて捨てる
+        spare_pool.clear();
+        root = spare_pool.copy_tree(*found);
+        node_pool.swap(spare_pool);
+        spare_pool.clear();
+        reused_visits = root->play_cnt;
+    } else {
+        node_pool.clear();
+        root = node_pool.allocate(1);
+    }
+    // このノードは既にプレイされているものとする
+    if (root->play_cnt == 0) {
+        root->play_cnt = 1;
+    }
+    if (root->state == NODE_UNVISITED) {
+        root->state = NODE_INITIALIZED;
+    }
+    tree_root = root;
+    tree_pos = pos;
+    return root;
+}
+
+// 今のところ探索量は固定なので、limitsは使わない
+Move Root::search([[maybe_unused]] const SearchLimits &limits) {
+    Node *root = prepare_root();
+    // 使い回した木のノードの深さは0から振り直しているので、
+    // 前回までの探索の深さが残らないようにリセットする
+    max_depth = 0;
+    MoveList move_list = generate_legal_moves(pos);
     int loop = 0;
     for (auto move : move_list) {
         if (move.is_drop()) {
@@ -15,36 +94,47 @@ Move Root::search() {
             loop += UCT_PER_MOVE;
         }
     }
-    // このノードは既にプレイされているものとする
-    root->play_cnt = 1;
-    for (int i = 0; i < loop; ++i) {
-        root->search();
+    // 全スレッドで同じ木を探索する。探索回数はカウンタで分け合う。
+    // 盤面は各スレッドが自分のコピーを持ち、指し手を実行しながら木を辿る。
+    std::atomic<int> loop_cnt(0);
+    auto worker = [this, root, loop, &loop_cnt]() {
+        Position thread_pos = pos;
+        while (loop_cnt.fetch_add(1, std::memory_order_relaxed) < loop) {
+            root->search(thread_pos, pos.side_to_move);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < thread_num; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &th : threads) {
+        th.join();
     }
 
     // 子ノードがない場合は投了
-    if (root->children.empty()) {
+    if (root->child_cnt == 0) {
         return Move(Move::RESIGN);
     }
+    std::vector<Node *> children;
+    for (int i = 0; i < root->child_cnt; ++i) {
+        children.push_back(&root->children[i]);
+    }
 
     // 評価値の高い順にソート
-    std::sort(root->children.begin(), root->children.end(), Node::compare);
+    std::sort(children.begin(), children.end(), Node::compare);
 
     std::cout << "=== SCORE ===" << std::endl;
-    for (auto child : root->children) {
+    for (auto child : children) {
         std::cout << child->move << ": " << child->rate() << std::endl;
     }
 
-    // 最も評価の高いノードが違法手の場合（＝合法手がない場合）も投了
-    Node *best_node = root->children[0];
-    if (best_node->is_illegal) {
-        return Move(Move::RESIGN);
-    }
-    Move best_move = best_node->move;
+    Move best_move = children[0]->move;
 
-    std::cout << "node_cnt: " << node_cnt << std::endl;
+    std::cout << "node_cnt: " << node_pool.size() << std::endl;
+    std::cout << "reused visits: " << reused_visits << std::endl;
     std::cout << "max_depth: " << max_depth << std::endl;
-
-    delete root;
+    std::cout << "threads: " << thread_num << std::endl;
 
     return best_move;
 }
\ No newline at end of file
@@ -1,9 +1,27 @@
 #include "../common/position.h"
+#include "../common/timeman.h"
 #include "node.h"
+#include "node_pool.h"
+#include <string>
 
 class Root {
   public:
     Root();
     Position pos;
-    Move search();
+    Move search(const SearchLimits &limits);
+    // USIのオプション
+    void send_options();
+    void set_option(const std::string &name, const std::string &value);
+    // プレイアウトのモデルの検証（モデルを使うのはhybridだけ）
+    bool check_network();
+
+  private:
+    Node *prepare_root();
+    Node *find_node(Node *node, Position &node_pos, int ply);
+
+    int thread_num = THREAD_NUM; // 探索スレッド数
+    // 前回の探索の木。次の探索で、実際に指された手の先の部分木を使い回す。
+    Node *tree_root = nullptr;
+    Position tree_pos;     // tree_rootの盤面
+    int reused_visits = 0; // 使い回した部分木の訪問回数
 };
\ No newline at end of file